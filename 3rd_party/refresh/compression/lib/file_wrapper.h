@@ -25,16 +25,19 @@
 #include <io.h>
 #endif
 
-#if defined(ARCH_X64)
-#if defined(REFRESH_USE_IGZIP)
+#if defined(ARCH_X64) && defined(REFRESH_USE_IGZIP)
 #define REFRESH_STREAM_DECOMPRESSION_ENABLE_IGZIP
-#else
-#define REFRESH_STREAM_DECOMPRESSION_ENABLE_ZLIB
 #endif
-#else
+
+// zlib(-ng) is also compiled in next to igzip if requested, so the engine can be chosen at runtime
+#if !defined(REFRESH_STREAM_DECOMPRESSION_ENABLE_IGZIP) || defined(REFRESH_USE_ZLIB)
 #define REFRESH_STREAM_DECOMPRESSION_ENABLE_ZLIB
 #endif
 
+#if defined(REFRESH_USE_ZSTD) && !defined(REFRESH_STREAM_DECOMPRESSION_ENABLE_ZSTD)
+#define REFRESH_STREAM_DECOMPRESSION_ENABLE_ZSTD
+#endif
+
 #ifdef REFRESH_STREAM_DECOMPRESSION_ENABLE_IGZIP
 #include <igzip_lib.h>
 #endif
@@ -764,10 +767,14 @@ namespace refresh
 	public:
 		enum class format_t { unknown, text, gzip, zstd };
 
+		// any - igzip if compiled in, zlib otherwise
+		enum class gzip_engine_t { any, igzip, zlib };
+
 	private:
 		stream_decompression_engine* engine = nullptr;
 		format_t format = format_t::unknown;
 		size_t engine_part_size;
+		gzip_engine_t gzip_engine;
 
 		char* buffer;
 		size_t size;
@@ -794,6 +801,11 @@ namespace refresh
 			if (stream_decompression_engine_gz::knows_it(stream_in->get_file_name(), ptr, filled))
 			{
 				format = format_t::gzip;
+#if defined(REFRESH_STREAM_DECOMPRESSION_ENABLE_IGZIP) && defined(REFRESH_STREAM_DECOMPRESSION_ENABLE_ZLIB)
+				if (gzip_engine == gzip_engine_t::zlib)
+					engine = new stream_decompression_engine_zlib(stream_in, engine_part_size, ptr, filled);
+				else
+#endif
 				engine = new stream_decompression_engine_gz(stream_in, engine_part_size, ptr, filled);
 			}
 			else 
@@ -824,8 +836,10 @@ namespace refresh
 		}
 
 	public:
-		stream_decompression(stream_in_base *stream_in, size_t engine_part_size = 16 << 20) :
-			engine_part_size(engine_part_size)
+		// gzip_engine is used only if it is compiled in
+		stream_decompression(stream_in_base *stream_in, size_t engine_part_size = 16 << 20, gzip_engine_t gzip_engine = gzip_engine_t::any) :
+			engine_part_size(engine_part_size),
+			gzip_engine(gzip_engine)
 		{
 			determine_format(stream_in);
 			eof_marker = false;
@@ -958,6 +972,27 @@ namespace refresh
 		{
 			return format;
 		}
+
+		static bool is_gzip_engine_available(gzip_engine_t gzip_engine)
+		{
+			switch (gzip_engine)
+			{
+			case gzip_engine_t::igzip:
+#ifdef REFRESH_STREAM_DECOMPRESSION_ENABLE_IGZIP
+				return true;
+#else
+				return false;
+#endif
+			case gzip_engine_t::zlib:
+#ifdef REFRESH_STREAM_DECOMPRESSION_ENABLE_ZLIB
+				return true;
+#else
+				return false;
+#endif
+			default:
+				return true;
+			}
+		}
 	};
 }
 
@@ -16,6 +16,8 @@ namespace refresh {
 		virtual void notify_popped() = 0;
 		virtual void notify_wait_on_push_time(std::chrono::nanoseconds time) = 0;
 		virtual void notify_wait_on_pop_time(std::chrono::nanoseconds time) = 0;
+		// Called only by queues that know footprints of their items
+		virtual void notify_pushed_bytes(size_t /*bytes*/) {}
 		virtual ~IQueueObserver() = default;
 	};
 
@@ -7,6 +7,9 @@
 #include <mutex>
 #include <condition_variable>
 #include <map>
+#include <deque>
+#include <functional>
+#include <atomic>
 
 namespace refresh {
 
@@ -201,30 +204,183 @@ namespace refresh {
 	};
 
 	//implements thread safe priority queue
+	/*
+	Items are kept in a ring of max_size slots indexed by priority % max_size, so
+	priority p can be pushed once current_priority + max_size > p. Priorities must be
+	consecutive (each one pushed exactly once) and are popped in increasing order.
+	The item of current_priority never waits, so the window cannot deadlock.
+	Producers wait on the condition variable of their slot and are woken only when
+	this slot is released; consumers are woken one at a time when the next item is ready.
+	In unordered mode the queue is a plain bounded FIFO (priorities are only passed through).
+	After cancel() all waiting and subsequent pushes and pops return immediately (pops return false).
+	Optionally the queue is also bounded by total footprint (in bytes) of stored items;
+	an item is always accepted by an empty queue (and in ordered mode if it is the next to pop).
+	*/
 	template<typename T>
 	class parallel_priority_queue
 	{
-		std::map<uint64_t, T> map_data;
+		struct slot_t
+		{
+			T elem{};
+			size_t bytes = 0;
+			bool ready = false;
+		};
+
+		struct fifo_item_t
+		{
+			uint64_t priority;
+			size_t bytes;
+			T elem;
+		};
+
+		std::vector<slot_t> ring;
+		std::vector<std::condition_variable> cv_slots;
 
 		size_t max_size;
+		size_t no_items = 0;
 		bool is_completed = false;
+		bool canceled = false;
 		size_t n_writers;
 
 		std::string name;
 		IQueueObserver* queue_observer;
 
 		std::mutex mtx;
-		std::condition_variable cv_push;
 		std::condition_variable cv_pop;
 		uint64_t current_priority{};
 
+		bool unordered = false;
+		std::deque<fifo_item_t> fifo;
+		std::condition_variable cv_push;
+
+		size_t max_bytes = 0;
+		size_t bytes = 0;
+		size_t peak_bytes = 0;
+		std::function<size_t(const T&)> footprint;
+		std::atomic<size_t>* total_bytes = nullptr;
+		std::condition_variable cv_bytes;
+
+		bool fits_in_bytes(size_t item_bytes) const
+		{
+			return max_bytes == 0 || no_items == 0 || bytes + item_bytes <= max_bytes;
+		}
+
+		void add_bytes(size_t item_bytes)
+		{
+			bytes += item_bytes;
+			if (bytes > peak_bytes)
+				peak_bytes = bytes;
+			if (total_bytes)
+				total_bytes->fetch_add(item_bytes);
+		}
+
+		void sub_bytes(size_t item_bytes)
+		{
+			bytes -= item_bytes;
+			if (total_bytes)
+				total_bytes->fetch_sub(item_bytes);
+		}
+
+		void take_unordered(T& elem, uint64_t& priority)
+		{
+			priority = fifo.front().priority;
+			elem = std::move(fifo.front().elem);
+			sub_bytes(fifo.front().bytes);
+			fifo.pop_front();
+			--no_items;
+
+			// With byte limit the released space can be enough for a few waiting items (or for none of them)
+			if (max_bytes)
+				cv_push.notify_all();
+			else
+				cv_push.notify_one();
+		}
+
+		void take_ordered(T& elem, uint64_t& priority)
+		{
+			auto& slot = ring[current_priority % max_size];
+
+			elem = std::move(slot.elem);
+			slot.ready = false;
+			sub_bytes(slot.bytes);
+			--no_items;
+			priority = current_priority;
+
+			// Slot is free now, so only the producer of current_priority + max_size can be waiting for it
+			cv_slots[current_priority % max_size].notify_all();
+
+			++current_priority;
+
+			// Producers waiting for bytes can have any priority (also the current one)
+			if (max_bytes)
+				cv_bytes.notify_all();
+
+			// Pass the baton to the next consumer if the next item is already here
+			if (ring[current_priority % max_size].ready)
+				cv_pop.notify_one();
+		}
+
+		bool pop_unordered(std::unique_lock<std::mutex>& lck, T& elem, uint64_t& priority)
+		{
+			cv_pop.wait(lck, [this] {
+				return is_completed || canceled || !fifo.empty();
+				});
+
+			if (canceled || fifo.empty())
+				return false;
+
+			take_unordered(elem, priority);
+
+			return true;
+		}
+
+		bool pop_impl(T& elem, uint64_t& priority)
+		{
+			auto time_start = std::chrono::high_resolution_clock::now();
+
+			std::unique_lock<std::mutex> lck(mtx);
+
+			if (unordered)
+			{
+				bool r = pop_unordered(lck, elem, priority);
+
+				if (queue_observer)
+				{
+					queue_observer->notify_wait_on_pop_time(std::chrono::high_resolution_clock::now() - time_start);
+					if (r)
+						queue_observer->notify_popped();
+				}
+
+				return r;
+			}
+
+			cv_pop.wait(lck, [this] {
+				return is_completed || canceled || ring[current_priority % max_size].ready;
+				});
+
+			if (queue_observer)
+				queue_observer->notify_wait_on_pop_time(std::chrono::high_resolution_clock::now() - time_start);
+
+			if (canceled || !ring[current_priority % max_size].ready)
+				return false;
+
+			take_ordered(elem, priority);
+
+			if (queue_observer)
+				queue_observer->notify_popped();
+
+			return true;
+		}
+
 	public:
 		parallel_priority_queue(
 			size_t size,
 			uint64_t n_writers = 1,
 			const std::string& name = "",
 			IQueueObserver* queue_observer = nullptr) :
-			max_size(size),
+			ring(size ? size : 1),
+			cv_slots(size ? size : 1),
+			max_size(size ? size : 1),
 			n_writers(n_writers),
 			name(name),
 			queue_observer(queue_observer)
@@ -239,52 +395,115 @@ namespace refresh {
 				this->queue_observer->set_queue_params(this->name, size);
 
 		}
-		void push(uint64_t priority, T&& elem)
+		// Returns false (and drops the item) if the queue was canceled
+		bool push_or_cancel(uint64_t priority, T&& elem)
 		{
 			auto time_start = std::chrono::high_resolution_clock::now();
 
+			size_t item_bytes = footprint ? footprint(elem) : 0;
+
 			std::unique_lock<std::mutex> lck(mtx);
-			cv_push.wait(lck, [this, &priority] {
-				return map_data.size() < max_size - 1 ||
-//					priority == current_priority;
-					priority <= current_priority;
+
+			if (unordered)
+			{
+				cv_push.wait(lck, [this, item_bytes] {
+					return canceled || (no_items < max_size && fits_in_bytes(item_bytes));
+					});
+
+				if (canceled)
+					return false;
+
+				if (queue_observer)
+					queue_observer->notify_wait_on_push_time(std::chrono::high_resolution_clock::now() - time_start);
+
+				fifo.push_back(fifo_item_t{ priority, item_bytes, std::move(elem) });
+				add_bytes(item_bytes);
+				++no_items;
+
+				cv_pop.notify_one();
+
+				if (queue_observer)
+				{
+					queue_observer->notify_pushed();
+					if (footprint)
+						queue_observer->notify_pushed_bytes(item_bytes);
+				}
+
+				return true;
+			}
+
+			cv_slots[priority % max_size].wait(lck, [this, &priority] {
+				return canceled || priority < current_priority + max_size;
 				});
 
+			if (max_bytes)
+				cv_bytes.wait(lck, [this, &priority, item_bytes] {
+					return canceled || priority == current_priority || fits_in_bytes(item_bytes);
+					});
+
+			if (canceled)
+				return false;
+
 			if (queue_observer)
 				queue_observer->notify_wait_on_push_time(std::chrono::high_resolution_clock::now() - time_start);
 
-			map_data.emplace(priority, std::move(elem));
+			auto& slot = ring[priority % max_size];
+			slot.elem = std::move(elem);
+			slot.bytes = item_bytes;
+			slot.ready = true;
+			add_bytes(item_bytes);
+			++no_items;
 
 			if (priority == current_priority)
-				cv_pop.notify_all();
-
-			cv_push.notify_all();
+				cv_pop.notify_one();
 
 			if (queue_observer)
+			{
 				queue_observer->notify_pushed();
+				if (footprint)
+					queue_observer->notify_pushed_bytes(item_bytes);
+			}
+
+			return true;
 		}
 
-		bool pop(T& elem)
+		void push(uint64_t priority, T&& elem)
 		{
-			auto time_start = std::chrono::high_resolution_clock::now();
+			push_or_cancel(priority, std::move(elem));
+		}
 
-			std::unique_lock<std::mutex> lck(mtx);
-			cv_pop.wait(lck, [this] {
-				return is_completed || (!map_data.empty() && map_data.begin()->first == current_priority);
-				});
+		bool pop(T& elem)
+		{
+			uint64_t priority;
 
-			if (queue_observer)
-				queue_observer->notify_wait_on_pop_time(std::chrono::high_resolution_clock::now() - time_start);
+			return pop_impl(elem, priority);
+		}
 
-			if (is_completed && map_data.empty())
-				return false;
+		bool pop(T& elem, uint64_t &priority)
+		{
+			return pop_impl(elem, priority);
+		}
 
-			elem = std::move(map_data.begin()->second);
-			map_data.erase(map_data.begin());
+		// Pops the next item only if it is available immediately
+		bool try_pop(T& elem, uint64_t& priority)
+		{
+			std::lock_guard<std::mutex> lck(mtx);
 
-			++current_priority;
+			if (canceled)
+				return false;
 
-			cv_push.notify_all();
+			if (unordered)
+			{
+				if (fifo.empty())
+					return false;
+				take_unordered(elem, priority);
+			}
+			else
+			{
+				if (!ring[current_priority % max_size].ready)
+					return false;
+				take_ordered(elem, priority);
+			}
 
 			if (queue_observer)
 				queue_observer->notify_popped();
@@ -292,36 +511,73 @@ namespace refresh {
 			return true;
 		}
 
-		bool pop(T& elem, uint64_t &priority)
+		// Returns true if all writers completed and all items were popped (or the queue was canceled)
+		bool check_completed()
 		{
-			auto time_start = std::chrono::high_resolution_clock::now();
+			std::lock_guard<std::mutex> lck(mtx);
+			return canceled || (is_completed && no_items == 0);
+		}
 
-			std::unique_lock<std::mutex> lck(mtx);
-			cv_pop.wait(lck, [this] {
-				return is_completed || (!map_data.empty() && map_data.begin()->first == current_priority);
-				});
+		// Wakes up all waiting threads; the remaining items are dropped
+		void cancel()
+		{
+			std::lock_guard<std::mutex> lck(mtx);
 
-			if (queue_observer)
-				queue_observer->notify_wait_on_pop_time(std::chrono::high_resolution_clock::now() - time_start);
+			canceled = true;
 
-			if (is_completed && map_data.empty())
-				return false;
+			cv_pop.notify_all();
+			cv_push.notify_all();
+			cv_bytes.notify_all();
+			for (auto& cv : cv_slots)
+				cv.notify_all();
+		}
 
-			elem = std::move(map_data.begin()->second);
-			priority = map_data.begin()->first;
-			map_data.erase(map_data.begin());
+		bool is_canceled()
+		{
+			std::lock_guard<std::mutex> lck(mtx);
+			return canceled;
+		}
 
-			++current_priority;
+		// Items are popped in the order of pushing, not priorities; must be set before the first push
+		void set_unordered(bool _unordered)
+		{
+			std::lock_guard<std::mutex> lck(mtx);
+			unordered = _unordered;
+		}
 
-			cv_push.notify_all();
+		// Limits total footprint of stored items (0 - no limit, footprints are then only reported to the observer); footprint is also added to total_bytes (if given),
+		// which can be shared by a few queues. Must be set before the first push
+		void set_max_bytes(size_t _max_bytes, std::function<size_t(const T&)> _footprint, std::atomic<size_t>* _total_bytes = nullptr)
+		{
+			std::lock_guard<std::mutex> lck(mtx);
+			max_bytes = _max_bytes;
+			footprint = _footprint;
+			total_bytes = _total_bytes;
+		}
 
-			if (queue_observer)
-				queue_observer->notify_popped();
+		size_t size()
+		{
+			std::lock_guard<std::mutex> lck(mtx);
+			return no_items;
+		}
 
-			return true;
+		// Max. total footprint of stored items (0 if footprint was not set)
+		size_t get_peak_bytes()
+		{
+			std::lock_guard<std::mutex> lck(mtx);
+			return peak_bytes;
 		}
 
-		//mkokot_TODO: implement Cancel and PushOrCancel
+		size_t size_in_bytes()
+		{
+			std::lock_guard<std::mutex> lck(mtx);
+			return bytes;
+		}
+
+		size_t get_max_size() const
+		{
+			return max_size;
+		}
 
 		void mark_completed()
 		{
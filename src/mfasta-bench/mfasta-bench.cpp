@@ -0,0 +1,636 @@
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <chrono>
+#include <functional>
+#include <unistd.h>
+
+#include "../mfasta-tool/defs.h"
+#include "../mfasta-tool/params.h"
+#include "../mfasta-tool/sha256.h"
+#include "../mfasta-tool/sha256_filter.h"
+#include "synthetic_data.h"
+#include "mrds_scaling.h"
+
+#include <refresh/compression/lib/file_wrapper.h>
+#include <refresh/compression/lib/gz_wrapper.h>
+#include <refresh/parallel_queues/lib/parallel-queues.h>
+
+using namespace std;
+
+const string BENCH_VER = "mfasta-bench v. 1.0.4 (2024-12-02)";
+const string BENCH_VERSION = "1.0.4";
+
+// *****************************************************************************************
+struct bench_params_t
+{
+	string csv_fn;
+	string tmp_dir = "/tmp";
+	string generate_fn;
+	vector<string> only;
+	vector<size_t> dict_keys = { 1'000'000, 100'000'000 };
+	size_t size_mb = 0;					// 0 - default of the mode
+	int repeat = 3;
+	uint64_t seed = 1;
+
+	// Scaling of mrds
+	bool scaling = false;
+	vector<string> workloads;
+	vector<uint32_t> threads;
+	vector<int> gzip_levels = { 0, 6 };
+	vector<string> dedup_modes = { "none", "dedup", "revcomp" };
+	vector<string> scheduling_modes = { "static" };
+	int64_t part_size = 0;
+
+	size_t get_size_mb() const
+	{
+		return size_mb ? size_mb : scaling ? 256 : 64;
+	}
+};
+
+bench_params_t bench_params;
+
+// Single row of the CSV report; seconds is the median of the repeats
+struct result_t
+{
+	string benchmark;
+	string variant;
+	uint32_t threads = 1;
+	uint64_t items = 0;
+	uint64_t bytes = 0;
+	double seconds = 0;
+};
+
+vector<result_t> results;
+
+// *****************************************************************************************
+vector<string> split(const string& str, char sep)
+{
+	vector<string> parts;
+	string s;
+
+	for (auto c : str)
+	{
+		if (c == sep)
+		{
+			parts.emplace_back(s);
+			s.clear();
+		}
+		else
+			s.push_back(c);
+	}
+
+	if (!s.empty())
+		parts.emplace_back(s);
+
+	return parts;
+}
+
+// ****************************************************************************
+bool selected(const string& benchmark)
+{
+	return bench_params.only.empty() || find(bench_params.only.begin(), bench_params.only.end(), benchmark) != bench_params.only.end();
+}
+
+// ****************************************************************************
+// Runs body (returning measured time in seconds) a few times and stores the median
+void measure(const string& benchmark, const string& variant, uint32_t threads, uint64_t items, uint64_t bytes, function<double()> body)
+{
+	vector<double> times;
+
+	for (int i = 0; i < bench_params.repeat; ++i)
+		times.emplace_back(body());
+
+	sort(times.begin(), times.end());
+
+	results.push_back(result_t{ benchmark, variant, threads, items, bytes, times[times.size() / 2] });
+
+	const auto& r = results.back();
+	std::cerr << r.benchmark << " " << r.variant << ": " << r.seconds << " s";
+	if (r.bytes)
+		std::cerr << ", " << r.bytes / r.seconds / 1e6 << " MB/s";
+	if (r.items)
+		std::cerr << ", " << r.items / r.seconds / 1e6 << " M items/s";
+	std::cerr << endl;
+}
+
+// ****************************************************************************
+template<typename F>
+double time_it(F f)
+{
+	auto t_start = chrono::steady_clock::now();
+	f();
+	return chrono::duration<double>(chrono::steady_clock::now() - t_start).count();
+}
+
+// ****************************************************************************
+string cpu_model()
+{
+	ifstream ifs("/proc/cpuinfo");
+	string line;
+
+	while (getline(ifs, line))
+		if (line.compare(0, 10, "model name") == 0)
+		{
+			auto p = line.find(':');
+			if (p != string::npos)
+				return line.substr(p + 2);
+		}
+
+	return "unknown";
+}
+
+// ****************************************************************************
+// Returns stream for the CSV report (stdout if file name is not given), nullptr on error
+ostream* open_csv(ofstream& ofs)
+{
+	if (bench_params.csv_fn.empty())
+		return &cout;
+
+	ofs.open(bench_params.csv_fn);
+	if (!ofs)
+	{
+		std::cerr << "Cannot open CSV file: " << bench_params.csv_fn << endl;
+		return nullptr;
+	}
+
+	return &ofs;
+}
+
+// ****************************************************************************
+string csv_prefix()
+{
+	string cpu = cpu_model();
+	replace(cpu.begin(), cpu.end(), ',', ' ');
+
+	return BENCH_VERSION + "," + cpu + "," + to_string(thread::hardware_concurrency()) + ",";
+}
+
+// ****************************************************************************
+bool write_csv()
+{
+	ofstream ofs;
+	ostream* out = open_csv(ofs);
+
+	if (!out)
+		return false;
+
+	string prefix = csv_prefix();
+
+	*out << "version,cpu,hw_threads,benchmark,variant,threads,repeats,items,bytes,seconds,mb_per_s,mitems_per_s\n";
+
+	for (const auto& r : results)
+		*out << prefix << r.benchmark << "," << r.variant << ","
+			<< r.threads << "," << bench_params.repeat << "," << r.items << "," << r.bytes << "," << r.seconds << ","
+			<< (r.bytes ? r.bytes / r.seconds / 1e6 : 0.0) << "," << (r.items ? r.items / r.seconds / 1e6 : 0.0) << "\n";
+
+	return true;
+}
+
+// ****************************************************************************
+bool write_scaling_csv(const vector<mrds_result_t>& scaling_results)
+{
+	ofstream ofs;
+	ostream* out = open_csv(ofs);
+
+	if (!out)
+		return false;
+
+	string prefix = csv_prefix();
+
+	*out << "version,cpu,hw_threads,workload,input_bytes,scheduling,threads,threads_used,gzip_level,dedup,rev_comp,repeats,seconds,mb_per_s,speedup,efficiency,peak_rss_mb\n";
+
+	for (const auto& r : scaling_results)
+		*out << prefix << r.config.workload << "," << r.input_bytes << "," << (r.config.dynamic ? "dynamic" : "static") << "," << r.config.threads << ","
+			<< r.threads_used << "," << r.config.gzip_level << "," << r.config.dedup << "," << r.config.rev_comp << "," << bench_params.repeat << "," << r.seconds << ","
+			<< r.input_bytes / r.seconds / 1e6 << "," << r.speedup << "," << r.efficiency << "," << (r.peak_rss >> 20) << "\n";
+
+	return true;
+}
+
+// ****************************************************************************
+bool write_file(const string& fn, const void* data, size_t size)
+{
+	FILE* f = fopen(fn.c_str(), "wb");
+
+	if (!f)
+	{
+		std::cerr << "Cannot create file: " << fn << endl;
+		return false;
+	}
+
+	bool ok = fwrite(data, 1, size, f) == size;
+
+	return fclose(f) == 0 && ok;
+}
+
+// ****************************************************************************
+// Reading lines of plain and gzipped FASTA files (I/O is mostly served by page cache after the first repeat)
+bool bench_getline(const string& fasta)
+{
+	string plain_fn = bench_params.tmp_dir + "/mfasta-bench-" + to_string(getpid()) + ".fa";
+	string gz_fn = plain_fn + ".gz";
+
+	refresh::gz_in_memory gim(6);
+	vector<uint8_t> gz(fasta.size() + gim.get_overhead(fasta.size()));
+	gz.resize(gim.compress(fasta.data(), fasta.size(), gz.data(), gz.size()));
+
+	if (!write_file(plain_fn, fasta.data(), fasta.size()) || !write_file(gz_fn, gz.data(), gz.size()))
+	{
+		remove(plain_fn.c_str());
+		return false;
+	}
+
+	using gzip_engine_t = refresh::stream_decompression::gzip_engine_t;
+
+	// Plain file and gzipped file with each of the compiled in decompression engines
+	vector<pair<string, gzip_engine_t>> variants = { { "plain", gzip_engine_t::any } };
+	for (auto engine : { gzip_engine_t::igzip, gzip_engine_t::zlib })
+		if (refresh::stream_decompression::is_gzip_engine_available(engine))
+			variants.emplace_back(engine == gzip_engine_t::igzip ? "gzip_isal" : "gzip_zlib", engine);
+
+	for (const auto& variant : variants)
+	{
+		const string& fn = variant.first == "plain" ? plain_fn : gz_fn;
+		auto engine = variant.second;
+		uint64_t no_lines = 0;
+
+		measure("getline", variant.first, 1, 0, fasta.size(), [&fn, engine, &no_lines] {
+			return time_it([&] {
+				refresh::stream_in_file in_file(fn);
+				refresh::stream_decompression sd(&in_file, 16 << 20, engine);
+				string line;
+
+				no_lines = 0;
+				while (!sd.eof())
+				{
+					sd.getline(line);
+					++no_lines;
+				}
+				});
+			});
+
+		results.back().items = no_lines;
+	}
+
+	remove(plain_fn.c_str());
+	remove(gz_fn.c_str());
+
+	return true;
+}
+
+// ****************************************************************************
+void bench_sha256(const string& fasta)
+{
+	for (size_t chunk : { (size_t)80, (size_t)1 << 20 })
+		measure("sha256_update", "chunk_" + to_string(chunk), 1, fasta.size() / chunk, fasta.size(), [&fasta, chunk] {
+			refresh::SHA256 sha;
+
+			return time_it([&] {
+				sha.reset();
+				for (size_t i = 0; i < fasta.size(); i += chunk)
+					sha.update((const uint8_t*)fasta.data() + i, min(chunk, fasta.size() - i));
+				sha.finalize();
+				});
+			});
+}
+
+// ****************************************************************************
+// Hashing of records as in the hashing stage; with rev. comp. both orientations are hashed
+void bench_hash_records()
+{
+	parallel_priority_queue<input_part_t> q_dummy(1);
+
+	for (bool both_dirs : { false, true })
+	{
+		CSyntheticFasta gen(bench_params.seed, 0.0, 1000, 20000);
+		vector<input_part_t> parts;
+		uint64_t bytes = 0, items = 0;
+
+		while (bytes < (bench_params.get_size_mb() << 20))
+		{
+			parts.emplace_back(gen.make_part(32));
+			for (const auto& item : parts.back())
+			{
+				for (const auto& line : item.lines)
+					bytes += line.size();
+				++items;
+			}
+		}
+
+		measure("hash_records", both_dirs ? "fwd_rc" : "fwd", 1, items, bytes, [&parts, both_dirs, &q_dummy] {
+			CSHA256Hasher hasher(q_dummy, q_dummy, both_dirs);
+
+			return time_it([&] {
+				for (auto& part : parts)
+					hasher.hash_part(part);
+				});
+			});
+	}
+}
+
+// ****************************************************************************
+// Inserting hashes to the dictionary of the filter (items are prepared outside of the measured time)
+void bench_dict()
+{
+	const size_t est_bytes_per_key = 200;
+	size_t mem_bytes = (size_t)sysconf(_SC_PHYS_PAGES) * (size_t)sysconf(_SC_PAGESIZE);
+	const size_t part_size = 1 << 16;
+
+	parallel_priority_queue<input_part_t> q_dummy(1);
+
+	for (auto no_keys : bench_params.dict_keys)
+	{
+		if (no_keys * est_bytes_per_key > mem_bytes / 2)
+		{
+			std::cerr << "dict " << no_keys << " keys: skipped (about " << ((no_keys * est_bytes_per_key) >> 30) << " GB of memory needed)" << endl;
+			continue;
+		}
+
+		measure("dict_insert", to_string(no_keys) + "_keys", 1, no_keys, 0, [no_keys, &q_dummy, part_size] {
+			CSHA256Filter filter(false, false, q_dummy, q_dummy, "", 32);
+			uint64_t state = bench_params.seed;
+			double t = 0;
+
+			input_part_t part;
+			part.reserve(part_size);
+
+			for (size_t done = 0; done < no_keys; )
+			{
+				part.clear();
+
+				for (size_t i = 0; i < part_size && done < no_keys; ++i, ++done)
+				{
+					// 10% of keys are repeated, so both paths of add_to_dict are used
+					uint64_t key = (done % 10 == 9) ? done / 2 : done;
+					part.emplace_back(">r" + to_string(done), "", vector<string>(1, "A"));
+
+					auto& hash = part.back().hash;
+					uint64_t x = key ^ state;
+					for (auto& h : hash)
+					{
+						x = (x ^ (x >> 31)) * 0x9e3779b97f4a7c15ull + 1;
+						h = (uint32_t)(x >> 32);
+					}
+				}
+
+				t += time_it([&] { filter.filter(part); });
+			}
+
+			return t;
+			});
+	}
+}
+
+// ****************************************************************************
+void bench_gzip(const string& fasta)
+{
+	refresh::gz_in_memory gim;
+	size_t src_size = min<size_t>(fasta.size(), 16 << 20);
+	vector<uint8_t> dest(src_size + gim.get_overhead(src_size));
+
+	for (int level = refresh::gz_in_memory::get_min_compression_level(); level <= refresh::gz_in_memory::get_max_compression_level(); ++level)
+	{
+		size_t packed = 0;
+
+		measure("gzip_compress", "level_" + to_string(level), 1, 0, src_size, [&, level] {
+			return time_it([&] { packed = gim.compress(fasta.data(), src_size, dest.data(), dest.size(), level); });
+			});
+
+		std::cerr << "   ratio: " << (double)src_size / max<size_t>(packed, 1) << endl;
+	}
+}
+
+// ****************************************************************************
+// Producers take consecutive priorities from a shared counter, so in ordered mode pushes come slightly out of order
+void bench_queue()
+{
+	const uint64_t no_items = 1 << 20;
+
+	for (bool unordered : { false, true })
+		for (uint32_t n : { 1u, 2u, 4u, 8u })
+			measure("priority_queue", string(unordered ? "unordered" : "ordered") + "_" + to_string(n) + "x" + to_string(n), 2 * n, no_items, 0, [n, unordered, no_items] {
+				parallel_priority_queue<uint64_t> q(128, n);
+				q.set_unordered(unordered);
+				atomic<uint64_t> counter{ 0 };
+
+				return time_it([&] {
+					vector<thread> threads;
+
+					for (uint32_t i = 0; i < n; ++i)
+						threads.emplace_back([&] {
+							uint64_t p;
+							while ((p = counter.fetch_add(1)) < no_items)
+								q.push(p, move(p));
+							q.mark_completed();
+							});
+
+					for (uint32_t i = 0; i < n; ++i)
+						threads.emplace_back([&] {
+							uint64_t x, p;
+							while (q.pop(x, p))
+								;
+							});
+
+					for (auto& t : threads)
+						t.join();
+					});
+				});
+}
+
+// ****************************************************************************
+// Runs mrds over the matrix of workloads, thread counts, gzip levels and duplicates removal modes
+bool bench_scaling()
+{
+	auto known = CMrdsScaling::known_workloads();
+	vector<mrds_workload_t> workloads;
+
+	if (bench_params.workloads.empty())
+		workloads = known;
+	else
+		for (const auto& name : bench_params.workloads)
+		{
+			auto p = find_if(known.begin(), known.end(), [&name](const mrds_workload_t& w) {return w.name == name; });
+			if (p == known.end())
+			{
+				std::cerr << "Unknown workload: " << name << endl;
+				return false;
+			}
+			workloads.emplace_back(*p);
+		}
+
+	// By default: powers of 2 up to the no. of hardware threads (and that no.)
+	vector<uint32_t> threads = bench_params.threads;
+	if (threads.empty())
+	{
+		uint32_t hw = max(1u, thread::hardware_concurrency());
+		for (uint32_t t = 1; t < hw; t *= 2)
+			threads.emplace_back(t);
+		threads.emplace_back(hw);
+	}
+
+	vector<mrds_config_t> configs;
+
+	for (const auto& workload : workloads)
+		for (const auto& mode : bench_params.dedup_modes)
+		{
+			if (mode != "none" && mode != "dedup" && mode != "revcomp")
+			{
+				std::cerr << "Unknown duplicates removal mode: " << mode << endl;
+				return false;
+			}
+
+			for (const auto& scheduling : bench_params.scheduling_modes)
+			{
+				if (scheduling != "static" && scheduling != "dynamic")
+				{
+					std::cerr << "Unknown scheduling mode: " << scheduling << endl;
+					return false;
+				}
+
+				for (auto level : bench_params.gzip_levels)
+					for (auto t : threads)
+						configs.push_back(mrds_config_t{ workload.name, t, level, mode != "none", mode == "revcomp", scheduling == "dynamic" });
+			}
+		}
+
+	CMrdsScaling scaling(bench_params.tmp_dir, bench_params.seed, bench_params.get_size_mb(), bench_params.repeat, bench_params.part_size);
+	vector<mrds_result_t> scaling_results;
+
+	if (!scaling.run(workloads, configs, scaling_results))
+		return false;
+
+	return write_scaling_csv(scaling_results);
+}
+
+// ****************************************************************************
+void usage()
+{
+	std::cerr << BENCH_VER << endl;
+	std::cerr << "Benchmarks of mfasta-tool\n";
+	std::cerr << "Usage:\n";
+	std::cerr << "mfasta-bench [options]          - microbenchmarks of the hot kernels\n";
+	std::cerr << "mfasta-bench scaling [options]  - end-to-end scaling of mrds over a matrix of options\n";
+	std::cerr << "Options:\n";
+	std::cerr << "   --csv <string>         - name of CSV file with results (default: stdout)\n";
+	std::cerr << "   --repeat <int>         - no. of repeats of each benchmark, median time is reported (default: " << bench_params.repeat << ")\n";
+	std::cerr << "   --size <int>           - size (in MB) of synthetic data (default: 64, scaling: 256)\n";
+	std::cerr << "   --seed <int>           - seed of synthetic data (default: " << bench_params.seed << ")\n";
+	std::cerr << "   --tmp-dir <string>     - directory for temporary files (default: " << bench_params.tmp_dir << ")\n";
+	std::cerr << "Options of microbenchmarks:\n";
+	std::cerr << "   --only <string>        - comma-separated list of benchmarks: getline, sha256, hash, dict, gzip, queue (default: all)\n";
+	std::cerr << "   --dict-keys <string>   - comma-separated list of no. of keys inserted to the duplicates dictionary (default: 1000000,100000000)\n";
+	std::cerr << "   --generate <string>    - only write synthetic FASTA of --size MB to the given file\n";
+	std::cerr << "Options of scaling:\n";
+	std::cerr << "   --workloads <string>   - comma-separated list of workloads: short-lowdup, short-highdup, chrom-lowdup, chrom-highdup (default: all)\n";
+	std::cerr << "   --threads <string>     - comma-separated list of no. of threads (default: powers of 2 up to no. of hardware threads);\n";
+	std::cerr << "                            static mode raises it to its minimum, counts giving the same pipeline are measured once\n";
+	std::cerr << "   --gzip-levels <string> - comma-separated list of gzip levels of output, 0 - plain output (default: 0,6)\n";
+	std::cerr << "   --dedup <string>       - comma-separated list of duplicates removal modes: none, dedup, revcomp (default: none,dedup,revcomp)\n";
+	std::cerr << "   --scheduling <string>  - comma-separated list of scheduling modes: static, dynamic (default: static)\n";
+	std::cerr << "   --part-size <int>      - no. of records in output part (default: 10000 for short records, 1 for chromosomes)\n";
+	std::cerr << "Examples:\n";
+	std::cerr << "   mfasta-bench --only sha256,gzip --csv results.csv\n";
+	std::cerr << "   mfasta-bench scaling --workloads short-lowdup --threads 4,8,16 --gzip-levels 1,6 --csv scaling.csv\n";
+}
+
+// ****************************************************************************
+bool parse_args(int argc, char** argv)
+{
+	int first = 1;
+
+	if (argc > 1 && argv[1] == "scaling"s)
+	{
+		bench_params.scaling = true;
+		first = 2;
+	}
+
+	for (int i = first; i < argc; ++i)
+	{
+		if (argv[i] == "--csv"s && i + 1 < argc)
+			bench_params.csv_fn = argv[++i];
+		else if (argv[i] == "--only"s && i + 1 < argc)
+			bench_params.only = split(argv[++i], ',');
+		else if (argv[i] == "--repeat"s && i + 1 < argc)
+			bench_params.repeat = max(1, atoi(argv[++i]));
+		else if (argv[i] == "--size"s && i + 1 < argc)
+			bench_params.size_mb = max(1, atoi(argv[++i]));
+		else if (argv[i] == "--workloads"s && i + 1 < argc && bench_params.scaling)
+			bench_params.workloads = split(argv[++i], ',');
+		else if (argv[i] == "--threads"s && i + 1 < argc && bench_params.scaling)
+		{
+			bench_params.threads.clear();
+			for (const auto& x : split(argv[++i], ','))
+				bench_params.threads.emplace_back(max(1, stoi(x)));
+		}
+		else if (argv[i] == "--gzip-levels"s && i + 1 < argc && bench_params.scaling)
+		{
+			bench_params.gzip_levels.clear();
+			for (const auto& x : split(argv[++i], ','))
+				bench_params.gzip_levels.emplace_back(stoi(x));
+		}
+		else if (argv[i] == "--dedup"s && i + 1 < argc && bench_params.scaling)
+			bench_params.dedup_modes = split(argv[++i], ',');
+		else if (argv[i] == "--scheduling"s && i + 1 < argc && bench_params.scaling)
+			bench_params.scheduling_modes = split(argv[++i], ',');
+		else if (argv[i] == "--part-size"s && i + 1 < argc && bench_params.scaling)
+			bench_params.part_size = stoll(argv[++i]);
+		else if (argv[i] == "--dict-keys"s && i + 1 < argc)
+		{
+			bench_params.dict_keys.clear();
+			for (const auto& x : split(argv[++i], ','))
+				bench_params.dict_keys.emplace_back(stoull(x));
+		}
+		else if (argv[i] == "--seed"s && i + 1 < argc)
+			bench_params.seed = stoull(argv[++i]);
+		else if (argv[i] == "--tmp-dir"s && i + 1 < argc)
+			bench_params.tmp_dir = argv[++i];
+		else if (argv[i] == "--generate"s && i + 1 < argc)
+			bench_params.generate_fn = argv[++i];
+		else
+		{
+			std::cerr << "Unknown option: " << argv[i] << endl;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// *****************************************************************************************
+int main(int argc, char** argv)
+{
+	if (!parse_args(argc, argv))
+	{
+		usage();
+		return 1;
+	}
+
+	if (bench_params.scaling)
+		return bench_scaling() ? 0 : 1;
+
+	string fasta;
+	CSyntheticFasta(bench_params.seed).append_fasta(fasta, bench_params.get_size_mb() << 20);
+
+	if (!bench_params.generate_fn.empty())
+		return write_file(bench_params.generate_fn, fasta.data(), fasta.size()) ? 0 : 1;
+
+	if (selected("getline") && !bench_getline(fasta))
+		return 1;
+	if (selected("sha256"))
+		bench_sha256(fasta);
+	if (selected("hash"))
+		bench_hash_records();
+	if (selected("dict"))
+		bench_dict();
+	if (selected("gzip"))
+		bench_gzip(fasta);
+	if (selected("queue"))
+		bench_queue();
+
+	return write_csv() ? 0 : 1;
+}
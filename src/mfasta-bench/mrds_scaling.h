@@ -0,0 +1,282 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <filesystem>
+#include <chrono>
+#include <cstdio>
+#include <cinttypes>
+#include <algorithm>
+#include <unistd.h>
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#include "../mfasta-tool/params.h"
+#include "../mfasta-tool/mrds.h"
+#include "synthetic_data.h"
+
+using namespace std;
+
+// Multi-FASTA workload of the scaling benchmark
+struct mrds_workload_t
+{
+	string name;
+	size_t min_len;
+	size_t max_len;
+	double dup_fraction;
+	int64_t part_size;			// no. of records in output part
+};
+
+// Single configuration of the matrix
+struct mrds_config_t
+{
+	string workload;
+	uint32_t threads = 1;
+	int gzip_level = 0;			// 0 - plain output
+	bool dedup = false;
+	bool rev_comp = false;
+	bool dynamic = false;		// dynamic scheduling (all requested threads are used by the pool)
+};
+
+struct mrds_result_t
+{
+	mrds_config_t config;
+	uint32_t threads_used = 0;	// threads doing work (the requested no. is raised to the minimum of the static mode)
+	uint64_t input_bytes = 0;
+	double seconds = 0;			// median of repeats
+	double speedup = 0;			// vs. the lowest no. of used threads with the same other options
+	double efficiency = 0;		// speedup scaled by the ratio of used thread counts
+	size_t peak_rss = 0;		// max. over repeats
+};
+
+// Runs process_mrds in-process over a matrix of workloads and options. Workloads are generated to temporary files
+// (so input is mostly read from page cache) and output parts are removed after each run.
+class CMrdsScaling
+{
+	string tmp_dir;
+	uint64_t seed;
+	size_t size_mb;
+	int repeat;
+	int64_t part_size;			// 0 - default of the workload
+
+	bool rss_reset_warned = false;
+
+	// Peak RSS of the process is reset before each run, so runs do not see peaks of the previous ones (Linux 4.0+).
+	// Memory freed by the previous run is returned to the system first, as the peak is reset to the current RSS.
+	bool reset_peak_rss()
+	{
+#ifdef __GLIBC__
+		malloc_trim(0);
+#endif
+
+		ofstream ofs("/proc/self/clear_refs");
+		ofs << "5";
+		ofs.flush();
+
+		if (ofs)
+			return true;
+
+		if (!rss_reset_warned)
+			std::cerr << "Warning: cannot reset peak RSS, reported values are peaks since the start of the benchmark" << endl;
+		rss_reset_warned = true;
+
+		return false;
+	}
+
+	bool generate(const mrds_workload_t& workload, const string& fn, uint64_t& bytes)
+	{
+		FILE* f = fopen(fn.c_str(), "wb");
+
+		if (!f)
+		{
+			std::cerr << "Cannot create file: " << fn << endl;
+			return false;
+		}
+
+		CSyntheticFasta gen(seed, workload.dup_fraction, workload.min_len, workload.max_len);
+		string buf;
+		bytes = 0;
+		bool ok = true;
+
+		while (ok && bytes < (size_mb << 20))
+		{
+			buf.clear();
+			gen.append_fasta(buf, std::min<size_t>(16 << 20, (size_mb << 20) - bytes));
+			ok = fwrite(buf.data(), 1, buf.size(), f) == buf.size();
+			bytes += buf.size();
+		}
+
+		if (fclose(f) != 0 || !ok)
+		{
+			std::cerr << "Cannot write file: " << fn << endl;
+			return false;
+		}
+
+		return true;
+	}
+
+	string out_dir() const
+	{
+		return tmp_dir + "/mfasta-bench-out-" + to_string(getpid());
+	}
+
+	CParams make_params(const mrds_workload_t& workload, const string& in_fn, const mrds_config_t& config) const
+	{
+		string out_dir = this->out_dir();
+		CParams params;
+		params.working_mode = CParams::working_mode_t::mrds;
+		params.in_names = { in_fn };
+		params.in_prefixes = { "" };
+		params.out_prefix = out_dir + "/part";
+		params.n = part_size ? part_size : workload.part_size;
+		params.no_threads = (int) config.threads;
+		params.output_format = config.gzip_level ? CParams::output_format_t::gzip : CParams::output_format_t::plain;
+		params.gzip_level = config.gzip_level ? config.gzip_level : params.gzip_level;
+		params.remove_duplicates = config.dedup;
+		params.rev_comp_as_equivalent = config.rev_comp;
+		params.dynamic_scheduling = config.dynamic;
+		params.out_duplicates = out_dir + "/duplicates.txt";		// stdout would be mixed with the report
+		params.verbosity = 0;
+
+		return params;
+	}
+
+	// Options other than the no. of threads
+	static bool same_options(const mrds_config_t& x, const mrds_config_t& y)
+	{
+		return x.gzip_level == y.gzip_level && x.dedup == y.dedup && x.rev_comp == y.rev_comp && x.dynamic == y.dynamic;
+	}
+
+	bool run_one(const mrds_workload_t& workload, const string& in_fn, const mrds_config_t& config, double& seconds, size_t& peak_rss)
+	{
+		string out_dir = this->out_dir();
+
+		error_code ec;
+		filesystem::remove_all(out_dir, ec);
+		if (!filesystem::create_directories(out_dir, ec))
+		{
+			std::cerr << "Cannot create directory: " << out_dir << endl;
+			return false;
+		}
+
+		CParams params = make_params(workload, in_fn, config);
+
+		reset_peak_rss();
+
+		auto t_start = chrono::steady_clock::now();
+		bool ok = process_mrds(params);
+		seconds = chrono::duration<double>(chrono::steady_clock::now() - t_start).count();
+
+		peak_rss = CMemoryStats::read_peak_rss();
+
+		filesystem::remove_all(out_dir, ec);
+
+		return ok;
+	}
+
+public:
+	CMrdsScaling(const string& tmp_dir, uint64_t seed, size_t size_mb, int repeat, int64_t part_size) :
+		tmp_dir(tmp_dir),
+		seed(seed),
+		size_mb(size_mb),
+		repeat(std::max(1, repeat)),
+		part_size(part_size)
+	{}
+
+	// Many short records (e.g., proteins, reads, viral genomes) or few chromosome-scale records, low or high rate of duplicates
+	static vector<mrds_workload_t> known_workloads()
+	{
+		return {
+			{ "short-lowdup", 200, 5000, 0.02, 10000 },
+			{ "short-highdup", 200, 5000, 0.5, 10000 },
+			{ "chrom-lowdup", 5'000'000, 50'000'000, 0.02, 1 },
+			{ "chrom-highdup", 5'000'000, 50'000'000, 0.5, 1 } };
+	}
+
+	// Results are grouped by workload, in order of configurations within a workload
+	bool run(const vector<mrds_workload_t>& workloads, const vector<mrds_config_t>& configs, vector<mrds_result_t>& results)
+	{
+		results.clear();
+
+		for (const auto& workload : workloads)
+		{
+			string in_fn = tmp_dir + "/mfasta-bench-" + to_string(getpid()) + "-" + workload.name + ".fa";
+			uint64_t input_bytes;
+
+			std::cerr << "Generating workload " << workload.name << " (" << size_mb << " MB)" << endl;
+			if (!generate(workload, in_fn, input_bytes))
+			{
+				remove(in_fn.c_str());
+				return false;
+			}
+
+			for (const auto& config : configs)
+			{
+				if (config.workload != workload.name)
+					continue;
+
+				CParams params = make_params(workload, in_fn, config);
+				uint32_t threads_used = mrds_thread_counts(params).total(params);
+
+				// Different requested thread counts can give the same pipeline, which is measured once
+				bool measured = any_of(results.begin(), results.end(), [&](const mrds_result_t& r) {
+					return r.config.workload == config.workload && same_options(r.config, config) && r.threads_used == threads_used; });
+
+				if (measured)
+				{
+					std::cerr << workload.name << " threads: " << config.threads << " - skipped, the same pipeline as for a lower no. of threads ("
+						<< threads_used << " threads used)" << endl;
+					continue;
+				}
+
+				vector<double> times;
+				mrds_result_t res{ config, threads_used, input_bytes };
+
+				for (int i = 0; i < repeat; ++i)
+				{
+					double seconds;
+					size_t peak_rss;
+
+					if (!run_one(workload, in_fn, config, seconds, peak_rss))
+					{
+						std::cerr << "Processing failed for workload " << workload.name << endl;
+						remove(in_fn.c_str());
+						return false;
+					}
+
+					times.emplace_back(seconds);
+					res.peak_rss = std::max(res.peak_rss, peak_rss);
+				}
+
+				sort(times.begin(), times.end());
+				res.seconds = times[times.size() / 2];
+				results.emplace_back(res);
+
+				std::cerr << workload.name << " threads: " << config.threads << " (" << threads_used << " used) dynamic: " << config.dynamic << " gzip level: " << config.gzip_level << " dedup: " << config.dedup
+					<< " rev-comp: " << config.rev_comp << ": " << res.seconds << " s, " << input_bytes / res.seconds / 1e6 << " MB/s, peak RSS "
+					<< (res.peak_rss >> 20) << " MB" << endl;
+			}
+
+			remove(in_fn.c_str());
+		}
+
+		// Speedup and efficiency relative to the lowest no. of used threads with the same workload and options
+		for (auto& r : results)
+		{
+			const mrds_result_t* base = nullptr;
+
+			for (const auto& b : results)
+				if (b.config.workload == r.config.workload && same_options(b.config, r.config) && (!base || b.threads_used < base->threads_used))
+					base = &b;
+
+			r.speedup = base->seconds / r.seconds;
+			r.efficiency = r.speedup * base->threads_used / r.threads_used;
+		}
+
+		return true;
+	}
+};
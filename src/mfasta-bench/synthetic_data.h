@@ -0,0 +1,142 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cinttypes>
+#include <algorithm>
+
+#include "../mfasta-tool/defs.h"
+
+using namespace std;
+
+// Deterministic generator of multi-FASTA data (the same seed gives the same data on all platforms).
+// A fraction of records are copies (optionally reverse-complemented) of earlier ones, so duplicates removal has some work.
+class CSyntheticFasta
+{
+	uint64_t state;
+	double dup_fraction;
+	size_t min_len;
+	size_t max_len;
+	size_t line_width;
+
+	const size_t max_kept = 256;
+	vector<string> kept;
+	uint64_t no_records = 0;
+
+	uint64_t next()
+	{
+		// splitmix64
+		uint64_t z = (state += 0x9e3779b97f4a7c15ull);
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+		return z ^ (z >> 31);
+	}
+
+	double next_double()
+	{
+		return (next() >> 11) * (1.0 / (1ull << 53));
+	}
+
+	static string rev_comp(const string& s)
+	{
+		string r(s.rbegin(), s.rend());
+
+		for (auto& c : r)
+			switch (c)
+			{
+			case 'A': c = 'T'; break;
+			case 'C': c = 'G'; break;
+			case 'G': c = 'C'; break;
+			case 'T': c = 'A'; break;
+			}
+
+		return r;
+	}
+
+	string next_sequence()
+	{
+		if (!kept.empty() && next_double() < dup_fraction)
+		{
+			const auto& src = kept[next() % kept.size()];
+			return (next() & 1) ? src : rev_comp(src);
+		}
+
+		size_t len = min_len + next() % (max_len - min_len + 1);
+		string seq(len, 'A');
+
+		static const char bases[] = "ACGT";
+		for (size_t i = 0; i < len; i += 32)
+		{
+			uint64_t r = next();
+			for (size_t j = i; j < min(len, i + 32); ++j, r >>= 2)
+				seq[j] = bases[r & 3];
+		}
+
+		if (kept.size() < max_kept)
+			kept.emplace_back(seq);
+		else
+			kept[next() % max_kept] = seq;
+
+		return seq;
+	}
+
+public:
+	CSyntheticFasta(uint64_t seed, double dup_fraction = 0.1, size_t min_len = 1000, size_t max_len = 100000, size_t line_width = 80) :
+		state(seed),
+		dup_fraction(dup_fraction),
+		min_len(min_len),
+		max_len(std::max(min_len, max_len)),
+		line_width(line_width)
+	{}
+
+	// Returns header (with '>') and lines of the next record
+	void next_record(string& header, vector<string>& lines)
+	{
+		header = ">seq" + to_string(no_records++) + " synthetic record";
+
+		string seq = next_sequence();
+
+		lines.clear();
+		for (size_t i = 0; i < seq.size(); i += line_width)
+			lines.emplace_back(seq.substr(i, line_width));
+	}
+
+	// Appends FASTA text of records until at least size bytes are generated
+	void append_fasta(string& out, size_t size)
+	{
+		string header;
+		vector<string> lines;
+
+		size_t end_size = out.size() + size;
+
+		while (out.size() < end_size)
+		{
+			next_record(header, lines);
+
+			out.append(header);
+			out.push_back('\n');
+
+			for (const auto& line : lines)
+			{
+				out.append(line);
+				out.push_back('\n');
+			}
+		}
+	}
+
+	// Part in the form produced by CDataSource
+	input_part_t make_part(size_t no_items)
+	{
+		input_part_t part;
+		string header;
+		vector<string> lines;
+
+		for (size_t i = 0; i < no_items; ++i)
+		{
+			next_record(header, lines);
+			part.emplace_back(header, "", lines);
+		}
+
+		return part;
+	}
+};
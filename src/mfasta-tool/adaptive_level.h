@@ -0,0 +1,72 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+#include <cinttypes>
+
+// Selects compression level for consecutive parts using occupancy of the queues before and after packers:
+// - queue of packed parts filling up - storer (disk) is the bottleneck, so spend more CPU time on better compression
+// - queue of parts to pack filling up - packers are the bottleneck, so compress faster
+class CAdaptiveCompressionLevel
+{
+	int min_level;
+	int max_level;
+	size_t update_interval;
+
+	std::mutex mtx;
+	int level;
+	size_t no_parts_since_update = 0;
+	std::vector<size_t> level_histogram;
+
+	const double high_fill = 0.5;
+	const double low_fill = 0.125;
+
+public:
+	CAdaptiveCompressionLevel(int min_level, int max_level, int start_level, size_t update_interval) :
+		min_level(std::min(min_level, max_level)),
+		max_level(std::max(min_level, max_level)),
+		update_interval(std::max<size_t>(1, update_interval))
+	{
+		level = std::clamp(start_level, this->min_level, this->max_level);
+		level_histogram.resize(this->max_level + 1, 0);
+	}
+
+	// Fill ratios are in range [0, 1]
+	int get_level(double in_queue_fill, double out_queue_fill)
+	{
+		std::lock_guard<std::mutex> lck(mtx);
+
+		// Level is changed at most once per update_interval parts to let the queues react
+		if (++no_parts_since_update >= update_interval)
+		{
+			if (out_queue_fill >= high_fill && level < max_level)
+			{
+				++level;
+				no_parts_since_update = 0;
+			}
+			else if (in_queue_fill >= high_fill && out_queue_fill <= low_fill && level > min_level)
+			{
+				--level;
+				no_parts_since_update = 0;
+			}
+		}
+
+		++level_histogram[level];
+
+		return level;
+	}
+
+	std::vector<std::pair<int, size_t>> get_stats()
+	{
+		std::lock_guard<std::mutex> lck(mtx);
+		std::vector<std::pair<int, size_t>> r;
+
+		for (int i = min_level; i <= max_level; ++i)
+			if (level_histogram[i])
+				r.emplace_back(i, level_histogram[i]);
+
+		return r;
+	}
+};
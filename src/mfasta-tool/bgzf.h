@@ -0,0 +1,144 @@
+#pragma once
+
+#include "defs.h"
+
+#include <array>
+#include <algorithm>
+#include <libdeflate.h>
+
+// BGZF (blocked gzip) compression as used by htslib/samtools
+class CBGZFCompressor
+{
+	static const size_t header_size = 18;
+	static const size_t footer_size = 8;
+	static const size_t max_packed_block_size = 1 << 16;
+
+	int compression_level;
+
+	libdeflate_compressor* ld_comp = nullptr;
+	libdeflate_compressor* ld_comp_store = nullptr;
+
+	void ensure_comp()
+	{
+		if (!ld_comp)
+			ld_comp = libdeflate_alloc_compressor(compression_level);
+	}
+
+	void ensure_comp_store()
+	{
+		if (!ld_comp_store)
+			ld_comp_store = libdeflate_alloc_compressor(0);
+	}
+
+	void free_comp()
+	{
+		if (ld_comp)
+		{
+			libdeflate_free_compressor(ld_comp);
+			ld_comp = nullptr;
+		}
+	}
+
+	static void store_u16(uint8_t* p, uint16_t x)
+	{
+		p[0] = (uint8_t) x;
+		p[1] = (uint8_t) (x >> 8);
+	}
+
+	static void store_u32(uint8_t* p, uint32_t x)
+	{
+		for (int i = 0; i < 4; ++i)
+			p[i] = (uint8_t) (x >> (8 * i));
+	}
+
+	// Returns total size of the block (header + deflate data + footer)
+	size_t compress_block(const uint8_t* src, size_t src_size, uint8_t* dest)
+	{
+		ensure_comp();
+
+		const size_t max_deflate_size = max_packed_block_size - header_size - footer_size;
+
+		size_t deflate_size = libdeflate_deflate_compress(ld_comp, src, src_size, dest + header_size, max_deflate_size);
+
+		// Not compressible enough to fit into BGZF block - store it
+		if (deflate_size == 0)
+		{
+			ensure_comp_store();
+			deflate_size = libdeflate_deflate_compress(ld_comp_store, src, src_size, dest + header_size, max_deflate_size);
+		}
+
+		size_t block_size = header_size + deflate_size + footer_size;
+
+		const std::array<uint8_t, 12> header_prefix = { 0x1f, 0x8b, 0x08, 0x04, 0, 0, 0, 0, 0, 0xff, 0x06, 0x00 };
+		std::copy(header_prefix.begin(), header_prefix.end(), dest);
+		dest[12] = 'B';
+		dest[13] = 'C';
+		store_u16(dest + 14, 2);
+		store_u16(dest + 16, (uint16_t) (block_size - 1));
+
+		store_u32(dest + header_size + deflate_size, libdeflate_crc32(0, src, src_size));
+		store_u32(dest + header_size + deflate_size + 4, (uint32_t) src_size);
+
+		return block_size;
+	}
+
+public:
+	// Max. size of uncompressed data in a single block (the same as in htslib)
+	static const size_t max_raw_block_size = 0xff00;
+
+	CBGZFCompressor(int compression_level) :
+		compression_level(std::clamp(compression_level, 1, 12))
+	{}
+
+	CBGZFCompressor(const CBGZFCompressor&) = delete;
+	CBGZFCompressor& operator=(const CBGZFCompressor&) = delete;
+
+	~CBGZFCompressor()
+	{
+		free_comp();
+
+		if (ld_comp_store)
+			libdeflate_free_compressor(ld_comp_store);
+	}
+
+	void set_compression_level(int level)
+	{
+		level = std::clamp(level, 1, 12);
+
+		if (level == compression_level)
+			return;
+
+		free_comp();
+		compression_level = level;
+	}
+
+	// Compress data into a series of BGZF blocks, sizes of blocks (packed, raw) are appended to blocks
+	void compress(const uint8_t* src, size_t src_size, memory_block_t& dest, vector<pair<uint32_t, uint32_t>>& blocks)
+	{
+		size_t no_blocks = (src_size + max_raw_block_size - 1) / max_raw_block_size;
+
+		dest.resize(no_blocks * max_packed_block_size);
+		size_t dest_pos = 0;
+
+		for (size_t pos = 0; pos < src_size; pos += max_raw_block_size)
+		{
+			size_t raw_size = std::min(max_raw_block_size, src_size - pos);
+			size_t packed_size = compress_block(src + pos, raw_size, dest.data() + dest_pos);
+
+			blocks.emplace_back((uint32_t) packed_size, (uint32_t) raw_size);
+			dest_pos += packed_size;
+		}
+
+		dest.resize(dest_pos);
+	}
+
+	// Empty block marking the end of BGZF file
+	static const std::array<uint8_t, 28>& eof_block()
+	{
+		static const std::array<uint8_t, 28> eof = {
+			0x1f, 0x8b, 0x08, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff, 0x06, 0x00, 0x42, 0x43, 0x02, 0x00,
+			0x1b, 0x00, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
+
+		return eof;
+	}
+};
@@ -0,0 +1,223 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <ostream>
+#include <algorithm>
+#include <thread>
+#include <map>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+using namespace std;
+
+// CPUs available to the process with their NUMA node, package (socket) and physical core (read from sysfs).
+// Threads are pinned in a compact order: physical cores of the first node, their SMT siblings, then the next node.
+// So stages exchanging parts share a socket as long as possible. Placement of memory is not controlled: parts are
+// allocated (and recycled) by the data source, so with more than one node most of them stay on the node of the source.
+class CCpuTopology
+{
+	struct cpu_t
+	{
+		int id;
+		int node;
+		int package;
+		int core;
+		int smt_rank;
+	};
+
+	vector<cpu_t> cpus;
+	vector<int> placement;
+	size_t next_slot = 0;
+	vector<pair<string, int>> assigned;
+
+	static bool read_line(const string& fn, string& line)
+	{
+		ifstream ifs(fn);
+
+		return (bool) getline(ifs, line);
+	}
+
+	static int read_int(const string& fn, int def)
+	{
+		string line;
+
+		if (!read_line(fn, line) || line.empty())
+			return def;
+
+		return atoi(line.c_str());
+	}
+
+	// Parses lists like "0-3,8,10-11"
+	static vector<int> parse_cpu_list(const string& s)
+	{
+		vector<int> r;
+		size_t pos = 0;
+
+		while (pos < s.size())
+		{
+			size_t end = s.find(',', pos);
+			if (end == string::npos)
+				end = s.size();
+
+			string range = s.substr(pos, end - pos);
+			size_t dash = range.find('-');
+
+			if (!range.empty())
+			{
+				int from = atoi(range.c_str());
+				int to = dash == string::npos ? from : atoi(range.c_str() + dash + 1);
+
+				for (int i = from; i <= to; ++i)
+					r.emplace_back(i);
+			}
+
+			pos = end + 1;
+		}
+
+		return r;
+	}
+
+	void detect()
+	{
+#ifdef __linux__
+		cpu_set_t cpu_set;
+		CPU_ZERO(&cpu_set);
+
+		if (sched_getaffinity(0, sizeof(cpu_set), &cpu_set) != 0)
+			return;
+
+		map<int, int> cpu_node;
+		string line;
+
+		if (read_line("/sys/devices/system/node/online", line))
+			for (int node : parse_cpu_list(line))
+			{
+				string cpu_list;
+				if (read_line("/sys/devices/system/node/node" + to_string(node) + "/cpulist", cpu_list))
+					for (int cpu : parse_cpu_list(cpu_list))
+						cpu_node[cpu] = node;
+			}
+
+		for (int i = 0; i < CPU_SETSIZE; ++i)
+		{
+			if (!CPU_ISSET(i, &cpu_set))
+				continue;
+
+			string topo = "/sys/devices/system/cpu/cpu" + to_string(i) + "/topology/";
+			auto p = cpu_node.find(i);
+
+			cpus.push_back(cpu_t{ i, p == cpu_node.end() ? 0 : p->second, read_int(topo + "physical_package_id", 0), read_int(topo + "core_id", i), 0 });
+		}
+
+		// SMT siblings get consecutive ranks
+		map<pair<int, int>, int> core_threads;
+		for (auto& cpu : cpus)
+			cpu.smt_rank = core_threads[make_pair(cpu.package, cpu.core)]++;
+#endif
+	}
+
+	void build_placement()
+	{
+		vector<cpu_t> sorted = cpus;
+
+		stable_sort(sorted.begin(), sorted.end(), [](const cpu_t& x, const cpu_t& y) {
+			if (x.node != y.node)
+				return x.node < y.node;
+			if (x.package != y.package)
+				return x.package < y.package;
+			if (x.smt_rank != y.smt_rank)
+				return x.smt_rank < y.smt_rank;
+			return x.core < y.core;
+			});
+
+		for (const auto& cpu : sorted)
+			placement.emplace_back(cpu.id);
+	}
+
+	const cpu_t* find_cpu(int id) const
+	{
+		for (const auto& cpu : cpus)
+			if (cpu.id == id)
+				return &cpu;
+
+		return nullptr;
+	}
+
+public:
+	CCpuTopology()
+	{
+		detect();
+		build_placement();
+	}
+
+	bool empty() const
+	{
+		return placement.empty();
+	}
+
+	// Returns the next CPU of the placement (wraps around if there are more threads than CPUs) or -1 if CPUs are unknown
+	int assign(const string& role)
+	{
+		if (placement.empty())
+			return -1;
+
+		int cpu = placement[next_slot++ % placement.size()];
+		assigned.emplace_back(role, cpu);
+
+		return cpu;
+	}
+
+	// Must be called at the start of the thread body, so the thread does not run (and allocate) anywhere else; -1 - no pinning
+	static bool pin_current_thread(int cpu)
+	{
+		if (cpu < 0)
+			return false;
+
+#ifdef __linux__
+		cpu_set_t cpu_set;
+		CPU_ZERO(&cpu_set);
+		CPU_SET(cpu, &cpu_set);
+
+		return pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set) == 0;
+#else
+		return false;
+#endif
+	}
+
+	void print(ostream& os) const
+	{
+		map<int, vector<int>> node_cpus;
+
+		for (const auto& cpu : cpus)
+			node_cpus[cpu.node].emplace_back(cpu.id);
+
+		os << "CPU topology: " << cpus.size() << " CPUs available, " << node_cpus.size() << " NUMA node(s)" << endl;
+
+		for (const auto& node : node_cpus)
+		{
+			os << "   node " << node.first << ":";
+			for (int id : node.second)
+			{
+				const cpu_t* cpu = find_cpu(id);
+				os << " " << id << "(p" << cpu->package << "c" << cpu->core << ")";
+			}
+			os << endl;
+		}
+
+		if (!assigned.empty())
+		{
+			os << "Thread placement:";
+			for (const auto& x : assigned)
+			{
+				const cpu_t* cpu = find_cpu(x.second);
+				os << " " << x.first << "->" << x.second << "(n" << cpu->node << ")";
+			}
+			os << endl;
+		}
+	}
+};
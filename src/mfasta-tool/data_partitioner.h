@@ -3,57 +3,164 @@
 #include "defs.h"
 #include "params.h"
 #include "data_source.h"
+#include "recycle_pool.h"
+#include "trace.h"
 
 class CDataPartitioner
 {
 	parallel_priority_queue<input_part_t>& q_input_parts;
 	parallel_priority_queue<input_part_t>& q_partitioned_parts;
 	size_t n_in_part;
+	size_t block_size;
+	CRecyclePool<input_part_t>* input_part_pool;
+
+	input_part_t partitioned_part;
+	size_t curr_part_bytes = 0;
+
+	size_t header_size(const input_item_t& item)
+	{
+		return item.id.size() + 1 + item.prefix.size();
+	}
+
+	size_t item_size(const input_item_t& item)
+	{
+		size_t r = header_size(item);
+
+		for (const auto& line : item.lines)
+			r += line.size() + 1;
+
+		return r;
+	}
+
+	void close_part(vector<input_part_t>& out_parts)
+	{
+		out_parts.emplace_back(move(partitioned_part));
+
+		partitioned_part.clear();
+		curr_part_bytes = 0;
+	}
+
+	// Parts are limited to block_size bytes, records longer than block_size are cut (at line boundaries) into fragments
+	void add_item_in_blocks(input_item_t& item, vector<input_part_t>& out_parts)
+	{
+		size_t size = item_size(item);
+
+		if (curr_part_bytes + size <= block_size)
+		{
+			partitioned_part.emplace_back(move(item));
+			curr_part_bytes += size;
+			return;
+		}
+
+		if (!partitioned_part.empty())
+			close_part(out_parts);
+
+		if (size <= block_size)
+		{
+			partitioned_part.emplace_back(move(item));
+			curr_part_bytes = size;
+			return;
+		}
+
+		size_t line_id = 0;
+		bool first = true;
+
+		while (true)
+		{
+			input_item_t fragment(item.id, item.prefix, vector<string>());
+			size_t fragment_size = first ? header_size(item) : 0;
+
+			fragment.first_fragment = first;
+			fragment.last_fragment = false;
+			fragment.file_id = item.file_id;
+			fragment.record_no = item.record_no;
+
+			for (; line_id < item.lines.size() && fragment_size < block_size; ++line_id)
+			{
+				fragment_size += item.lines[line_id].size() + 1;
+				fragment.lines.emplace_back(move(item.lines[line_id]));
+			}
+
+			first = false;
+
+			if (line_id == item.lines.size())
+			{
+				fragment.last_fragment = true;
+				partitioned_part.emplace_back(move(fragment));
+				curr_part_bytes = fragment_size;
+				break;
+			}
+
+			partitioned_part.emplace_back(move(fragment));
+			close_part(out_parts);
+		}
+	}
 
 public:
-	CDataPartitioner(parallel_priority_queue<input_part_t>& q_input_parts, parallel_priority_queue<input_part_t>& q_partitioned_parts, size_t n_in_part) :
+	CDataPartitioner(parallel_priority_queue<input_part_t>& q_input_parts, parallel_priority_queue<input_part_t>& q_partitioned_parts, size_t n_in_part, size_t block_size = 0,
+		CRecyclePool<input_part_t>* input_part_pool = nullptr) :
 		q_input_parts(q_input_parts),
 		q_partitioned_parts(q_partitioned_parts),
-		n_in_part(n_in_part)
+		n_in_part(n_in_part),
+		block_size(block_size),
+		input_part_pool(input_part_pool)
 	{}
 
-	bool run()
+	// Splits an input part into output parts (appended to out_parts); output parts never span input parts,
+	// so input parts can be split independently (but not concurrently by the same object)
+	void split(input_part_t& input_part, vector<input_part_t>& out_parts)
 	{
-		input_part_t input_part;
-		input_part_t partitioned_part;
 		size_t curr_part_size = 0;
-		size_t priority = 0;
 
-		while (q_input_parts.pop(input_part))
+		for (auto& item : input_part)
 		{
-			for (auto& item : input_part)
-			{
+			if (block_size)
+				add_item_in_blocks(item, out_parts);
+			else
 				partitioned_part.emplace_back(move(item));
-				if (++curr_part_size == n_in_part)
-				{
-					q_partitioned_parts.push(priority, move(partitioned_part));
 
-					partitioned_part.clear();
-					curr_part_size = 0;
-					++priority;
-				}
-			}
-
-			if (!partitioned_part.empty())
+			if (++curr_part_size == n_in_part)
 			{
-				q_partitioned_parts.push(priority, move(partitioned_part));
-
-				partitioned_part.clear();
+				close_part(out_parts);
 				curr_part_size = 0;
-				++priority;
 			}
 		}
 
-		if(!partitioned_part.empty())
-			q_partitioned_parts.push(priority, move(partitioned_part));
+		if (!partitioned_part.empty())
+			close_part(out_parts);
+	}
+
+	bool run()
+	{
+		input_part_t input_part;
+		vector<input_part_t> out_parts;
+		uint64_t priority = 0;
+		uint64_t input_priority;
+		bool canceled = false;
+
+		while (!canceled && q_input_parts.pop(input_part, input_priority))
+		{
+			{
+				CTraceSpan span("partition", input_priority, "input_part");
+				split(input_part, out_parts);
+			}
+
+			for (auto& part : out_parts)
+				if (!q_partitioned_parts.push_or_cancel(priority++, move(part)))
+				{
+					canceled = true;
+					break;
+				}
+
+			out_parts.clear();
+
+			// Items were moved out, but the vector is returned to the data source
+			if (input_part_pool)
+				input_part_pool->put(move(input_part));
+		}
 
 		q_partitioned_parts.mark_completed();
 
 		return true;
 	}
-};
\ No newline at end of file
+};
@@ -2,14 +2,44 @@
 
 #include "defs.h"
 #include "params.h"
+#include "memory_governor.h"
+#include "recycle_pool.h"
+#include "trace.h"
+#include "progress.h"
+#include "memory_stats.h"
+#include "inflate_engine.h"
+#include "error_state.h"
 
 #include <cctype>
+#include <atomic>
 
 #include <refresh/parallel_queues/lib/parallel-queues.h>
 #include <refresh/compression/lib/file_wrapper.h>
 
 using namespace refresh;
 
+// Input file reporting no. of bytes read (before decompression) to the progress reporter
+class CCountingInFile : public stream_in_file
+{
+	CProgress* progress;
+
+public:
+	CCountingInFile(const string& file_name, CProgress* progress) :
+		stream_in_file(file_name),
+		progress(progress)
+	{}
+
+	std::pair<char*, size_t> read() override
+	{
+		auto r = stream_in_file::read();
+
+		if (progress)
+			progress->add_compressed(r.second);
+
+		return r;
+	}
+};
+
 class CDataSource
 {
 	vector<string> input_names;
@@ -19,24 +49,95 @@ class CDataSource
 	size_t soft_limit_size_in_part;
 	bool remove_empty_lines;
 	uint64_t priority = 0;
+	int64_t part_trace_start = 0;
+	bool canceled = false;
 	uint32_t verbosity;
+	CMemoryGovernor* memory_governor;
+	CRecyclePool<input_part_t>* input_part_pool;
+	CProgress* progress;
+	CMemoryStats* memory_stats;
+	CInflateEngineSelector inflate_engine_selector;
+	const atomic<bool>* stop_reading;
+	bool stopped = false;
+	uint64_t part_raw_bytes = 0;
+	CStageError error;
+
+	// Default sizes of buffers of stream_in_file (I/O and read) and stream_decompression
+	const size_t decompression_buffers_size = (16 << 20) + (8 << 20) + (16 << 20);
 
 	input_part_t input_buffer;
 
-	bool load_file(const string& fn, const string &prefix)
+	// Line strings of recycled parts (their buffers are reused for reading next lines)
+	const size_t max_spare_lines_bytes = 64 << 20;
+	const size_t max_spare_line_capacity = 64 << 10;
+	vector<string> spare_lines;
+	size_t spare_lines_bytes = 0;
+	uint64_t no_lines = 0;
+	uint64_t no_reused_lines = 0;
+
+	void prepare_input_buffer()
+	{
+		input_buffer.clear();
+
+		if (input_part_pool && input_part_pool->get(input_buffer))
+		{
+			for (auto& item : input_buffer)
+				for (auto& line : item.lines)
+					if (line.capacity() <= max_spare_line_capacity && spare_lines_bytes + line.capacity() <= max_spare_lines_bytes)
+					{
+						spare_lines_bytes += line.capacity();
+						spare_lines.emplace_back(move(line));
+					}
+
+			input_buffer.clear();
+		}
+
+		input_buffer.reserve(no_seq_in_part);
+
+		if (memory_stats)
+			memory_stats->spare_lines.set(spare_lines_bytes);
+	}
+
+	void take_spare_line(string& line)
+	{
+		++no_lines;
+
+		if (spare_lines.empty())
+			return;
+
+		spare_lines_bytes -= spare_lines.back().capacity();
+		line = move(spare_lines.back());
+		spare_lines.pop_back();
+		++no_reused_lines;
+	}
+
+	// Called just before the part is passed to the queue
+	void report_part()
 	{
-		stream_in_file msgz(fn);
+		if (progress)
+			progress->add_parsed(part_raw_bytes, input_buffer.size());
+
+		part_raw_bytes = 0;
+	}
+
+	bool load_file(const string& fn, const string &prefix, uint32_t file_id)
+	{
+		CCountingInFile msgz(fn, progress);
+
+		// Buffers are allocated also if the file cannot be opened; released in run() after the file is closed
+		if (memory_stats)
+			memory_stats->decompression_buffers.add(decompression_buffers_size);
 
 		if(verbosity > 0)
 			cerr << "Processing " << fn << endl;
 
 		if (!msgz.is_open())
 		{
-			cerr << "Error: cannot open " << fn << endl;
+			error.set("cannot open " + fn);
 			return false;
 		}
 
-		stream_decompression sdf(&msgz);
+		stream_decompression sdf(&msgz, 16 << 20, inflate_engine_selector.get(fn));
 		string line;
 		size_t seq_len_in_part = 0;
 		size_t no_seqs = 0;
@@ -61,26 +162,62 @@ class CDataSource
 					if (input_buffer.size() == no_seq_in_part || seq_len_in_part >= soft_limit_size_in_part)
 					{
 						input_buffer.back().lines.shrink_to_fit();
-						q_input_parts.push(priority++, move(input_buffer));
-						input_buffer.clear();
-						input_buffer.reserve(no_seq_in_part);
+						trace_add("parse", priority, part_trace_start, "input_part");
+						report_part();
+						if (!q_input_parts.push_or_cancel(priority++, move(input_buffer)))
+						{
+							canceled = true;
+							return false;
+						}
+
+						if (memory_governor)
+						{
+							CTraceSpan span("throttled", priority, "input_part");
+							memory_governor->wait_for_room();
+						}
+
+						part_trace_start = trace_now();
+
+						prepare_input_buffer();
 						seq_len_in_part = 0;
+
+						// Consumer does not need more data (checked at part boundaries only)
+						if (stop_reading && stop_reading->load(memory_order_relaxed))
+						{
+							if (verbosity > 0)
+								cerr << "Reading stopped in " << fn << " after " << no_seqs - 1 << " sequences" << endl;
+							stopped = true;
+							return true;
+						}
 					}
 
+					part_raw_bytes += line.size() + 1;
 					input_buffer.emplace_back(line, prefix, vector<string>());
+					input_buffer.back().file_id = file_id;
+					input_buffer.back().record_no = no_seqs - 1;
 					input_buffer.back().lines.reserve(1024);
 					continue;
 				}
 
 				seq_len_in_part += line.size();
+				part_raw_bytes += line.size() + 1;
 				input_buffer.back().lines.emplace_back(move(line));
+				take_spare_line(line);
 			}
 		}
 
 		if (!input_buffer.empty())
 		{
 			input_buffer.back().lines.shrink_to_fit();
-			q_input_parts.push(priority++, move(input_buffer));
+			trace_add("parse", priority, part_trace_start, "input_part");
+			report_part();
+			if (!q_input_parts.push_or_cancel(priority++, move(input_buffer)))
+			{
+				canceled = true;
+				return false;
+			}
+			prepare_input_buffer();
+			part_trace_start = trace_now();
 		}
 
 		if (verbosity > 0)
@@ -91,30 +228,64 @@ class CDataSource
 
 public:
 	CDataSource(const vector<string>& input_names, const vector<string>& input_prefixes, parallel_priority_queue<input_part_t> &q_input_parts, bool remove_empty_lines, const size_t no_seq_in_part, const size_t soft_limit_size_in_part,
-		const uint32_t verbosity) :
+		const uint32_t verbosity, CMemoryGovernor* memory_governor = nullptr, CRecyclePool<input_part_t>* input_part_pool = nullptr, CProgress* progress = nullptr,
+		CMemoryStats* memory_stats = nullptr, CParams::inflate_engine_t inflate_engine = CParams::inflate_engine_t::auto_select, const atomic<bool>* stop_reading = nullptr) :
 		input_names(input_names),
 		input_prefixes(input_prefixes),
 		q_input_parts(q_input_parts),
 		remove_empty_lines(remove_empty_lines),
 		no_seq_in_part(no_seq_in_part),
 		soft_limit_size_in_part(soft_limit_size_in_part),
-		verbosity(verbosity)
+		verbosity(verbosity),
+		memory_governor(memory_governor),
+		input_part_pool(input_part_pool),
+		progress(progress),
+		memory_stats(memory_stats),
+		inflate_engine_selector(inflate_engine),
+		stop_reading(stop_reading)
 	{
 	}
 
 	bool run()
 	{
 		priority = 0;
+		part_trace_start = trace_now();
 
 		for (size_t i = 0; i < input_names.size(); ++i)
-			if (!load_file(input_names[i], input_prefixes[i]))
+		{
+			bool ok = load_file(input_names[i], input_prefixes[i], (uint32_t) i);
+
+			if (memory_stats)
+				memory_stats->decompression_buffers.add(-(int64_t) decompression_buffers_size);
+
+			if (!ok)
 			{
 				q_input_parts.mark_completed();
-				return false;
+				return canceled;
 			}
 
+			if (stopped)
+				break;
+		}
+
 		q_input_parts.mark_completed();
 
 		return true;
 	}
+
+	string get_error() const
+	{
+		return error.get();
+	}
+
+	string get_inflate_engine() const
+	{
+		return inflate_engine_selector.get_report();
+	}
+
+	void get_stats(uint64_t& _no_lines, uint64_t& _no_reused_lines)
+	{
+		_no_lines = no_lines;
+		_no_reused_lines = no_reused_lines;
+	}
 };
@@ -2,12 +2,47 @@
 
 #include "params.h"
 #include "data_source.h"
+#include "bgzf.h"
+#include "zstd_wrapper.h"
+#include "recycle_pool.h"
+#include "trace.h"
+#include "progress.h"
+#include "error_state.h"
 #include <memory>
 #include <list>
 #include <thread>
+#include <atomic>
+#include <fstream>
+#include <mutex>
+#include <cstring>
+
+#ifndef _WIN32
+#include <sys/uio.h>
+#include <unistd.h>
+#include <climits>
+#include <cerrno>
+#endif
 
 class CDataStorer
 {
+	struct out_file_t
+	{
+		FILE* out = nullptr;
+		string fn;
+		vector<pair<uint32_t, uint32_t>> blocks;
+		uint64_t raw_size = 0;
+		vector<fai_entry_t> fai_entries;
+		vector<record_range_t> record_ranges;
+	};
+
+	struct store_task_t
+	{
+		int part_id = -1;
+		bool close_after = false;
+		uint64_t priority = 0;
+		packed_part_t packed_part;
+	};
+
 	parallel_priority_queue<packed_part_t>& q_packed_parts;
 	size_t n_in_part;
 	string out_name;
@@ -15,69 +50,326 @@ class CDataStorer
 	string out_suffix;
 	int part_digits;
 	int verbosity;
+	size_t no_workers;
+	CParams::output_format_t output_format;
+	bool zstd_seekable;
+	bool write_fai;
+	string manifest_fn;
+	vector<string> in_names;
+	CRecyclePool<input_part_t>* input_part_pool;
+	CRecyclePool<packed_part_t>* packed_part_pool;
+	CProgress* progress;
+
+	mutex mtx_manifest;
+	vector<pair<string, vector<record_range_t>>> manifest;
 
 	int part_id = 0;
 	size_t no_stored = 0;
+	atomic<size_t> no_parts = 0;
+	CStageError error;
 
-	string part_fn()
+	string part_fn(int id)
 	{
-		string id(part_digits, '0');
-		id += to_string(part_id);
-		id = id.substr(id.length() - part_digits, part_digits);
+		string s_id(part_digits, '0');
+		s_id += to_string(id);
+		s_id = s_id.substr(s_id.length() - part_digits, part_digits);
 
-		return out_prefix + "_" + id + "." + out_suffix;
+		return out_prefix + "_" + s_id + "." + out_suffix;
 	}
 
-	bool open_file(FILE* &out, const string& fn)
+	bool open_file(out_file_t &out_file, const string& fn)
 	{
-		if (out)
-			fclose(out);
+		if (out_file.out)
+			close_file(out_file);
 
-		out = fopen(fn.c_str(), "wb");
+		out_file.out = fopen(fn.c_str(), "wb");
 
-		if (!out)
+		if (!out_file.out)
 		{
-			cerr << "Cannot open file: " << fn << endl;
+			error.set("cannot open file: " + fn + " (" + strerror(errno) + ")");
 			return false;
 		}
 
-		setvbuf(out, nullptr, _IOFBF, 16 << 20);
+		setvbuf(out_file.out, nullptr, _IOFBF, 16 << 20);
+
+		out_file.fn = fn;
+		out_file.blocks.clear();
+		out_file.raw_size = 0;
+		out_file.fai_entries.clear();
+		out_file.record_ranges.clear();
+
+		++no_parts;
 		
 		return true;
 	}
 
-public:
-	CDataStorer(parallel_priority_queue<packed_part_t>& q_packed_parts, size_t _n_in_part,
-		string out_name, string out_prefix, string out_suffix, int part_digits, int verbosity) :
-		q_packed_parts(q_packed_parts),
-		n_in_part(_n_in_part),
-		out_name(out_name),
-		out_prefix(out_prefix),
-		out_suffix(out_suffix),
-		part_digits(part_digits),
-		verbosity(verbosity)
+	// Scatter-gather write of uncompressed data
+	bool write_views(FILE* out, const vector<string_view>& views)
 	{
-		if (!out_name.empty())
-			n_in_part = ~(size_t)0;
+#ifdef _WIN32
+		for (const auto& v : views)
+			if (fwrite(v.data(), 1, v.size(), out) != v.size())
+				return false;
+#else
+		const size_t max_iov = IOV_MAX;
+
+		fflush(out);
+		int fd = fileno(out);
+
+		vector<iovec> iov;
+		iov.reserve(std::min(max_iov, views.size()));
+
+		for (size_t i = 0; i < views.size(); )
+		{
+			iov.clear();
+			for (; i < views.size() && iov.size() < max_iov; ++i)
+				iov.push_back(iovec{ (void*)views[i].data(), views[i].size() });
+
+			iovec* p = iov.data();
+			int n = (int)iov.size();
+
+			while (n > 0)
+			{
+				ssize_t written = writev(fd, p, n);
+
+				if (written < 0)
+				{
+					if (errno == EINTR)
+						continue;
+					return false;
+				}
+
+				// Skip fully written buffers and adjust partially written one
+				while (n > 0 && (size_t)written >= p->iov_len)
+				{
+					written -= p->iov_len;
+					++p;
+					--n;
+				}
+
+				if (n > 0)
+				{
+					p->iov_base = (char*)p->iov_base + written;
+					p->iov_len -= written;
+				}
+			}
+		}
+#endif
+
+		return true;
 	}
 
-	bool run()
+	bool write_part(out_file_t& out_file, const packed_part_t& packed_part)
+	{
+		bool ok;
+
+		if (!packed_part.views.empty())
+			ok = write_views(out_file.out, packed_part.views);
+		else
+			ok = fwrite(packed_part.memory_block.data(), 1, packed_part.memory_block.size(), out_file.out) == packed_part.memory_block.size();
+
+		if (!ok || ferror(out_file.out))
+		{
+			error.set("error while writing file: " + out_file.fn + " (" + strerror(errno) + ")");
+			return false;
+		}
+
+		out_file.blocks.insert(out_file.blocks.end(), packed_part.blocks.begin(), packed_part.blocks.end());
+
+		if (write_fai)
+			for (const auto& entry : packed_part.fai_entries)
+			{
+				if (entry.continuation && !out_file.fai_entries.empty())
+				{
+					auto& prev = out_file.fai_entries.back();
+					prev.length += entry.length;
+					if (prev.line_bases == 0)
+					{
+						prev.line_bases = entry.line_bases;
+						prev.line_width = entry.line_width;
+					}
+				}
+				else
+				{
+					out_file.fai_entries.emplace_back(entry);
+					out_file.fai_entries.back().offset += out_file.raw_size;
+				}
+			}
+
+		out_file.raw_size += packed_part.raw_size;
+
+		if (!manifest_fn.empty())
+			for (const auto& range : packed_part.record_ranges)
+			{
+				auto& ranges = out_file.record_ranges;
+
+				if (!ranges.empty() && ranges.back().file_id == range.file_id && range.first <= ranges.back().last + 1 && range.first >= ranges.back().first)
+					ranges.back().last = std::max(ranges.back().last, range.last);
+				else
+					ranges.emplace_back(range);
+			}
+
+		return true;
+	}
+
+	// Stored part goes back to the packers and its source records (uncompressed output) to the data source
+	void recycle(packed_part_t& packed_part)
+	{
+		if (input_part_pool && !packed_part.source_part.empty())
+		{
+			packed_part.views.clear();
+			input_part_pool->put(move(packed_part.source_part));
+		}
+
+		packed_part.clear();
+
+		if (packed_part_pool)
+			packed_part_pool->put(move(packed_part));
+	}
+
+	// Manifest lists ranges of input records (0-based indices within input files) stored in each part
+	bool store_manifest()
+	{
+		ofstream ofs(manifest_fn, std::ios::binary);
+
+		if (!ofs)
+		{
+			error.set("cannot open file: " + manifest_fn);
+			return false;
+		}
+
+		sort(manifest.begin(), manifest.end(), [](const auto& x, const auto& y) {return x.first < y.first; });
+
+		ofs << "#part\tinput_file\tfirst_record\tno_records\n";
+
+		for (const auto& part : manifest)
+			for (const auto& range : part.second)
+				ofs << part.first << "\t" << in_names[range.file_id] << "\t" << range.first << "\t" << range.last - range.first + 1 << "\n";
+
+		return true;
+	}
+
+	// .fai index (offsets in uncompressed data, so for BGZF output it is used together with .gzi)
+	bool store_fai(const out_file_t& out_file)
+	{
+		string fn = out_file.fn + ".fai";
+		ofstream ofs(fn, std::ios::binary);
+
+		if (!ofs)
+		{
+			error.set("cannot open file: " + fn + " (" + strerror(errno) + ")");
+			return false;
+		}
+
+		for (const auto& entry : out_file.fai_entries)
+			ofs << entry.name << "\t" << entry.length << "\t" << entry.offset << "\t" << entry.line_bases << "\t" << entry.line_width << "\n";
+
+		return true;
+	}
+
+	// .gzi index in the format used by bgzip/htslib
+	bool store_gzi(const out_file_t& out_file)
+	{
+		string fn = out_file.fn + ".gzi";
+		FILE* out = fopen(fn.c_str(), "wb");
+
+		if (!out)
+		{
+			error.set("cannot open file: " + fn + " (" + strerror(errno) + ")");
+			return false;
+		}
+
+		vector<uint8_t> data;
+		data.reserve(8 * (1 + 2 * out_file.blocks.size()));
+
+		auto append_u64 = [&data](uint64_t x) {
+			for (int i = 0; i < 8; ++i)
+				data.emplace_back((uint8_t)(x >> (8 * i)));
+			};
+
+		uint64_t packed_offset = 0;
+		uint64_t raw_offset = 0;
+
+		append_u64(out_file.blocks.size());
+		for (const auto& block : out_file.blocks)
+		{
+			packed_offset += block.first;
+			raw_offset += block.second;
+
+			append_u64(packed_offset);
+			append_u64(raw_offset);
+		}
+
+		fwrite(data.data(), 1, data.size(), out);
+		fclose(out);
+
+		return true;
+	}
+
+	bool close_file(out_file_t& out_file)
+	{
+		bool ok = true;
+
+		if (output_format == CParams::output_format_t::bgzf)
+		{
+			const auto& eof = CBGZFCompressor::eof_block();
+			fwrite(eof.data(), 1, eof.size(), out_file.out);
+
+			ok = store_gzi(out_file);
+		}
+#ifdef REFRESH_USE_ZSTD
+		else if (output_format == CParams::output_format_t::zstd && zstd_seekable)
+		{
+			vector<uint8_t> seek_table;
+			CZstdCompressor::build_seek_table(out_file.blocks, seek_table);
+			fwrite(seek_table.data(), 1, seek_table.size(), out_file.out);
+		}
+#endif
+
+		if (write_fai && !store_fai(out_file))
+			ok = false;
+
+		if (!manifest_fn.empty())
+		{
+			lock_guard<mutex> lck(mtx_manifest);
+			manifest.emplace_back(out_file.fn, move(out_file.record_ranges));
+		}
+
+		// Buffered data is written by fclose, so also its errors are write errors
+		if (fclose(out_file.out) != 0)
+		{
+			error.set("error while writing file: " + out_file.fn + " (" + strerror(errno) + ")");
+			ok = false;
+		}
+		out_file.out = nullptr;
+
+		if (progress)
+			progress->add_part_written();
+
+		return ok;
+	}
+
+	// Single storer - parts are written one after another by the calling thread
+	bool run_single()
 	{
 		packed_part_t input_part;
+		uint64_t priority;
 		size_t curr_part_size = 0;
-		FILE* out = nullptr;
+		out_file_t out_file;
 
-		if (!open_file(out, out_name.empty() ? part_fn() : out_name))
+		if (!open_file(out_file, out_name.empty() ? part_fn(part_id) : out_name))
 			return false;
 
 		if (verbosity > 0)
 			cerr << "Part: " << part_id << "\r";
 
-		while (q_packed_parts.pop(input_part))
+		while (q_packed_parts.pop(input_part, priority))
 		{
-			if (!out)
+			CTraceSpan span("store", priority);
+
+			if (!out_file.out)
 			{
-				if (!open_file(out, part_fn()))
+				if (!open_file(out_file, part_fn(part_id)))
 					return false;
 
 				if (verbosity > 0)
@@ -85,30 +377,192 @@ public:
 
 			}
 
-			fwrite(input_part.memory_block.data(), 1, input_part.memory_block.size(), out);
+			if (!write_part(out_file, input_part))
+			{
+				close_file(out_file);
+				return false;
+			}
+
 			curr_part_size += input_part.no_items;
 
 			no_stored += input_part.no_items;
+			if (progress)
+				progress->add_stored(input_part.no_items);
+
+			recycle(input_part);
 
 			if (curr_part_size >= n_in_part)
 			{
-				fclose(out);
+				if (!close_file(out_file))
+					return false;
 				++part_id;
 
-				out = nullptr;
-
 				curr_part_size = 0;
 			}
 		}
 
-		if (out)
-			fclose(out);
+		if (out_file.out)
+			return close_file(out_file);
 		
 		return true;
 	}
 
-	void get_stats(size_t& _no_stored)
+	// Worker owning files of part ids assigned to it by the dispatcher
+	bool store_worker(parallel_queue<store_task_t>& q_tasks)
+	{
+		store_task_t task;
+		out_file_t out_file;
+		bool ok = true;
+
+		while (q_tasks.pop(task))
+		{
+			// After an error (or cancellation) the queue is still drained to not block the dispatcher
+			if (!ok || q_packed_parts.is_canceled())
+				continue;
+
+			CTraceSpan span("store", task.priority);
+
+			if (!out_file.out && !open_file(out_file, part_fn(task.part_id)))
+			{
+				ok = false;
+				continue;
+			}
+
+			if (!write_part(out_file, task.packed_part))
+			{
+				ok = false;
+				continue;
+			}
+
+			if (task.close_after && !close_file(out_file))
+				ok = false;
+
+			recycle(task.packed_part);
+		}
+
+		if (out_file.out && !close_file(out_file))
+			ok = false;
+
+		return ok;
+	}
+
+	// Many storers - dispatcher decides (sequentially) on the part id of each packed part, workers write files in parallel
+	bool run_multi()
+	{
+		vector<unique_ptr<parallel_queue<store_task_t>>> vq_tasks;
+		vector<thread> vt_workers;
+		atomic<bool> workers_ok = true;
+
+		for (size_t i = 0; i < no_workers; ++i)
+			vq_tasks.emplace_back(make_unique<parallel_queue<store_task_t>>(16));
+
+		// Workers are traced if the dispatcher is
+		CTracer* tracer = CTraceThread::tracer();
+
+		for (size_t i = 0; i < no_workers; ++i)
+			vt_workers.emplace_back([&, i] {
+				CTraceThread trace_thread(tracer, "storer worker " + to_string(i));
+				if (!store_worker(*vq_tasks[i]))
+					workers_ok = false;
+				});
+
+		packed_part_t input_part;
+		uint64_t priority;
+		size_t curr_part_size = 0;
+		bool any_pushed = false;
+
+		while (workers_ok && q_packed_parts.pop(input_part, priority))
+		{
+			if (verbosity > 0 && curr_part_size == 0)
+				cerr << "Part: " << part_id << "\r";
+
+			curr_part_size += input_part.no_items;
+			no_stored += input_part.no_items;
+			if (progress)
+				progress->add_stored(input_part.no_items);
+
+			store_task_t task;
+			task.part_id = part_id;
+			task.close_after = curr_part_size >= n_in_part;
+			task.priority = priority;
+			task.packed_part = move(input_part);
+
+			vq_tasks[part_id % no_workers]->push(move(task));
+			any_pushed = true;
+
+			if (curr_part_size >= n_in_part)
+			{
+				++part_id;
+				curr_part_size = 0;
+			}
+		}
+
+		// Empty input still produces the first (empty) part
+		if (!any_pushed && !q_packed_parts.is_canceled())
+		{
+			store_task_t task;
+			task.part_id = 0;
+			task.close_after = true;
+			vq_tasks.front()->push(move(task));
+		}
+
+		for (auto& q : vq_tasks)
+			q->mark_completed();
+
+		for (auto& t : vt_workers)
+			t.join();
+
+		return workers_ok;
+	}
+
+public:
+	CDataStorer(parallel_priority_queue<packed_part_t>& q_packed_parts, size_t _n_in_part,
+		string out_name, string out_prefix, string out_suffix, int part_digits, int verbosity, size_t no_workers = 1,
+		CParams::output_format_t output_format = CParams::output_format_t::plain, bool zstd_seekable = false, bool write_fai = false,
+		const string& manifest_fn = "", const vector<string>& in_names = {},
+		CRecyclePool<input_part_t>* input_part_pool = nullptr, CRecyclePool<packed_part_t>* packed_part_pool = nullptr, CProgress* progress = nullptr) :
+		q_packed_parts(q_packed_parts),
+		n_in_part(_n_in_part),
+		out_name(out_name),
+		out_prefix(out_prefix),
+		out_suffix(out_suffix),
+		part_digits(part_digits),
+		verbosity(verbosity),
+		no_workers(std::max<size_t>(1, no_workers)),
+		output_format(output_format),
+		zstd_seekable(zstd_seekable),
+		write_fai(write_fai),
+		manifest_fn(manifest_fn),
+		in_names(in_names),
+		input_part_pool(input_part_pool),
+		packed_part_pool(packed_part_pool),
+		progress(progress)
+	{
+		if (!out_name.empty())
+		{
+			n_in_part = ~(size_t)0;
+			this->no_workers = 1;
+		}
+	}
+
+	bool run()
+	{
+		bool ok = no_workers == 1 ? run_single() : run_multi();
+
+		if (!manifest_fn.empty() && !store_manifest())
+			ok = false;
+
+		return ok;
+	}
+
+	string get_error() const
+	{
+		return error.get();
+	}
+
+	void get_stats(size_t& _no_stored, size_t& _no_parts)
 	{
 		_no_stored = no_stored;
+		_no_parts = no_parts;
 	}
-};
\ No newline at end of file
+};
@@ -1,10 +1,13 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <cinttypes>
+#include <algorithm>
 
 #include "sha256.h"
+#include "huge_page_allocator.h"
 
 using namespace std;
 
@@ -14,25 +17,61 @@ struct input_item_t
 	string prefix;
 	refresh::SHA256::sha256_t hash{};
 	bool hash_orientation_fwd;
+	bool first_fragment;		// header is stored together with this fragment of a record
+	bool last_fragment;			// record is completed with this fragment
+	uint32_t file_id;			// index of the input file
+	uint64_t record_no;			// 0-based index of the record in the input file
 	vector<string> lines;
 
 	input_item_t(const string& id, const string &prefix, const vector<string>& lines) :
-		id(id), prefix(prefix), hash{}, hash_orientation_fwd(true), lines(lines)
+		id(id), prefix(prefix), hash{}, hash_orientation_fwd(true), first_fragment(true), last_fragment(true), file_id(0), record_no(0), lines(lines)
 	{}
 };
 
 using input_part_t = vector<input_item_t>;
 
-using memory_block_t = vector<uint8_t>;
+using memory_block_t = vector<uint8_t, huge_page_allocator<uint8_t>>;
+
+// Single record of .fai index
+struct fai_entry_t
+{
+	string name;
+	uint64_t length = 0;
+	uint64_t offset = 0;			// offset of the first base (in uncompressed data)
+	uint32_t line_bases = 0;
+	uint32_t line_width = 0;
+	bool continuation = false;		// entry extends the previous one (next fragment of the same record)
+};
+
+// Range of consecutive records of a single input file (inclusive)
+struct record_range_t
+{
+	uint32_t file_id = 0;
+	uint64_t first = 0;
+	uint64_t last = 0;
+};
 
 struct packed_part_t
 {
 	size_t no_items;
 	memory_block_t memory_block;
+	vector<pair<uint32_t, uint32_t>> blocks;		// (packed, raw) sizes of independently decompressible blocks (BGZF blocks, zstd frames)
+	vector<fai_entry_t> fai_entries;				// offsets relative to the beginning of the part
+	size_t raw_size = 0;
+	vector<record_range_t> record_ranges;			// input records contained in the part (for manifest)
+
+	// Uncompressed output: data to store is given as views to the lines of source_part (instead of memory_block)
+	vector<string_view> views;
+	input_part_t source_part;
 
 	packed_part_t() : no_items(0)
 	{}
 
+	packed_part_t(const packed_part_t&) = delete;
+	packed_part_t& operator=(const packed_part_t&) = delete;
+	packed_part_t(packed_part_t&&) = default;
+	packed_part_t& operator=(packed_part_t&&) = default;
+
 	packed_part_t(size_t no_items, const memory_block_t& memory_block) :
 		no_items(no_items),
 		memory_block(memory_block)
@@ -46,8 +85,42 @@ struct packed_part_t
 	void clear()
 	{
 		memory_block.clear();
-
-		if(memory_block.capacity() > 8 << 20)
-			memory_block.shrink_to_fit();
+		blocks.clear();
+		fai_entries.clear();
+		raw_size = 0;
+		record_ranges.clear();
+		views.clear();
+		source_part.clear();
 	}
 };
+
+// Approximate memory footprint (in bytes) of parts
+inline size_t footprint(const input_item_t& item)
+{
+	size_t r = sizeof(input_item_t) + item.id.capacity() + item.prefix.capacity() + item.lines.capacity() * sizeof(string);
+
+	for (const auto& line : item.lines)
+		r += line.capacity();
+
+	return r;
+}
+
+inline size_t footprint(const input_part_t& part)
+{
+	size_t r = sizeof(input_part_t) + (part.capacity() - part.size()) * sizeof(input_item_t);
+
+	for (const auto& item : part)
+		r += footprint(item);
+
+	return r;
+}
+
+inline size_t footprint(const packed_part_t& part)
+{
+	return sizeof(packed_part_t) + part.memory_block.capacity()
+		+ part.blocks.capacity() * sizeof(pair<uint32_t, uint32_t>)
+		+ part.fai_entries.capacity() * sizeof(fai_entry_t)
+		+ part.record_ranges.capacity() * sizeof(record_range_t)
+		+ part.views.capacity() * sizeof(string_view)
+		+ footprint(part.source_part);
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include "defs.h"
+#include "sha256_filter.h"
+#include "part_packer.h"
+
+#include <thread>
+#include <chrono>
+#include <atomic>
+
+#include <refresh/parallel_queues/lib/parallel-queues.h>
+
+using namespace refresh;
+
+// Worker of the shared pool executing hashing and packing tasks.
+// Each time the stage with the larger backlog (relative fill of its input queue) is tried first,
+// so the no. of workers busy with each stage follows the bottleneck.
+class CDynamicWorker
+{
+	parallel_priority_queue<input_part_t>* q_to_hash;
+	parallel_priority_queue<input_part_t>& q_to_pack;
+	CSHA256Hasher* hasher;
+	CPartPacker& packer;
+
+	atomic<uint64_t>& no_hash_tasks;
+	atomic<uint64_t>& no_pack_tasks;
+	atomic<int64_t>* idle_ns;
+
+	static double fill(parallel_priority_queue<input_part_t>& q)
+	{
+		return (double)q.size() / q.get_max_size();
+	}
+
+public:
+	// q_to_hash and hasher are nullptr if duplicates are not removed; time of idle polls is added to idle_ns (if given)
+	CDynamicWorker(parallel_priority_queue<input_part_t>* q_to_hash, parallel_priority_queue<input_part_t>& q_to_pack,
+		CSHA256Hasher* hasher, CPartPacker& packer, atomic<uint64_t>& no_hash_tasks, atomic<uint64_t>& no_pack_tasks,
+		atomic<int64_t>* idle_ns = nullptr) :
+		q_to_hash(q_to_hash),
+		q_to_pack(q_to_pack),
+		hasher(hasher),
+		packer(packer),
+		no_hash_tasks(no_hash_tasks),
+		no_pack_tasks(no_pack_tasks),
+		idle_ns(idle_ns)
+	{}
+
+	bool run()
+	{
+		input_part_t input_part;
+		uint64_t priority;
+		bool hash_done = hasher == nullptr;
+		bool pack_done = false;
+		int no_idle_loops = 0;
+		bool canceled = false;
+
+		auto try_hash = [&] {
+			if (hash_done || !q_to_hash->try_pop(input_part, priority))
+				return false;
+			if (!hasher->process(input_part, priority))
+				canceled = true;
+			++no_hash_tasks;
+			return true;
+			};
+
+		auto try_pack = [&] {
+			if (pack_done || !q_to_pack.try_pop(input_part, priority))
+				return false;
+			if (!packer.process(input_part, priority))
+				canceled = true;
+			++no_pack_tasks;
+			return true;
+			};
+
+		while ((!hash_done || !pack_done) && !canceled)
+		{
+			bool prefer_hash = !hash_done && fill(*q_to_hash) > fill(q_to_pack);
+
+			if (prefer_hash ? (try_hash() || try_pack()) : (try_pack() || try_hash()))
+			{
+				no_idle_loops = 0;
+				continue;
+			}
+
+			// Stage is finished when its input queue is completed and drained (its output is completed by the last worker)
+			if (!hash_done && q_to_hash->check_completed())
+			{
+				hasher->mark_completed();
+				hash_done = true;
+				continue;
+			}
+
+			if (!pack_done && q_to_pack.check_completed())
+			{
+				packer.mark_completed();
+				pack_done = true;
+				continue;
+			}
+
+			// Nothing to do at the moment
+			auto t_idle = idle_ns ? chrono::steady_clock::now() : chrono::steady_clock::time_point{};
+
+			if (++no_idle_loops < 16)
+				this_thread::yield();
+			else
+				this_thread::sleep_for(chrono::microseconds(200));
+
+			if (idle_ns)
+				*idle_ns += chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - t_idle).count();
+		}
+
+		return !packer.is_failed();
+	}
+};
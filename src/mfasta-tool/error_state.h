@@ -0,0 +1,73 @@
+#pragma once
+
+#include <string>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <functional>
+
+using namespace std;
+
+// First error message of a stage (set by any of its threads), passed to CErrorState when the stage fails
+class CStageError
+{
+	mutable mutex mtx;
+	string message;
+
+public:
+	void set(const string& msg)
+	{
+		lock_guard<mutex> lck(mtx);
+
+		if (message.empty())
+			message = msg;
+	}
+
+	string get() const
+	{
+		lock_guard<mutex> lck(mtx);
+		return message;
+	}
+};
+
+// Keeps the first error reported by any stage and cancels the whole pipeline when it happens
+class CErrorState
+{
+	mutex mtx;
+	string first_error;
+	atomic<bool> failed{ false };
+	vector<function<void()>> cancel_callbacks;
+
+public:
+	void add_cancel_callback(function<void()> callback)
+	{
+		lock_guard<mutex> lck(mtx);
+		cancel_callbacks.emplace_back(callback);
+	}
+
+	// Message describes the cause (e.g., a file that cannot be opened); failures caused by cancellation are reported with the stage name only
+	void report(const string& stage, const string& message = "")
+	{
+		lock_guard<mutex> lck(mtx);
+
+		if (failed)
+			return;
+
+		first_error = message.empty() ? "failure of stage: " + stage : message + " (stage: " + stage + ")";
+		failed = true;
+
+		for (auto& callback : cancel_callbacks)
+			callback();
+	}
+
+	bool is_failed() const
+	{
+		return failed;
+	}
+
+	string get_first_error()
+	{
+		lock_guard<mutex> lck(mtx);
+		return first_error;
+	}
+};
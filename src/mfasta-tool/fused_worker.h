@@ -0,0 +1,148 @@
+#pragma once
+
+#include "defs.h"
+#include "sha256_filter.h"
+#include "data_partitioner.h"
+#include "part_packer.h"
+#include "recycle_pool.h"
+#include "trace.h"
+
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+
+#include <refresh/parallel_queues/lib/parallel-queues.h>
+
+using namespace refresh;
+
+// Order-sensitive steps of the fused mode: removal of duplicates (the first occurrence of a sequence is preserved)
+// and numbering of output parts. Parts enter the section in order of their priorities (in arrival order in unordered mode),
+// so the output is the same as in the staged pipeline.
+class CFusedSection
+{
+	CSHA256Filter* filter;
+	CDataPartitioner& partitioner;
+	bool ordered;
+
+	mutex mtx;
+	condition_variable cv_turn;
+	uint64_t next_input_priority = 0;
+	uint64_t next_output_priority = 0;
+	bool canceled = false;
+
+	atomic<int64_t>* wait_ns;
+
+public:
+	// filter is nullptr if duplicates are not removed; time of waiting for the lock and the turn is added to wait_ns (if given)
+	CFusedSection(CSHA256Filter* filter, CDataPartitioner& partitioner, bool ordered, atomic<int64_t>* wait_ns = nullptr) :
+		filter(filter),
+		partitioner(partitioner),
+		ordered(ordered),
+		wait_ns(wait_ns)
+	{}
+
+	// Filters the part and splits it into output parts numbered from first_output_priority; returns false if canceled
+	bool process(input_part_t& input_part, uint64_t input_priority, vector<input_part_t>& out_parts, uint64_t& first_output_priority)
+	{
+		auto t_wait = wait_ns ? chrono::steady_clock::now() : chrono::steady_clock::time_point{};
+
+		unique_lock<mutex> lck(mtx);
+
+		if (ordered)
+			cv_turn.wait(lck, [&] {return canceled || next_input_priority == input_priority; });
+
+		if (wait_ns)
+			*wait_ns += chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - t_wait).count();
+
+		if (canceled)
+			return false;
+
+		if (filter)
+			filter->filter(input_part);
+
+		partitioner.split(input_part, out_parts);
+
+		first_output_priority = next_output_priority;
+		next_output_priority += out_parts.size();
+		++next_input_priority;
+
+		lck.unlock();
+
+		if (ordered)
+			cv_turn.notify_all();
+
+		return true;
+	}
+
+	void cancel()
+	{
+		lock_guard<mutex> lck(mtx);
+		canceled = true;
+		cv_turn.notify_all();
+	}
+};
+
+// Worker of the fused mode: hashes a part, passes it through the ordered section and packs the resulting output parts,
+// so the part does not travel through the queues (and between cores) between the stages
+class CFusedWorker
+{
+	parallel_priority_queue<input_part_t>& q_input_parts;
+	CSHA256Hasher* hasher;
+	CFusedSection& section;
+	CPartPacker& packer;
+	CRecyclePool<input_part_t>* input_part_pool;
+
+public:
+	// hasher is nullptr if duplicates are not removed
+	CFusedWorker(parallel_priority_queue<input_part_t>& q_input_parts, CSHA256Hasher* hasher, CFusedSection& section, CPartPacker& packer,
+		CRecyclePool<input_part_t>* input_part_pool = nullptr) :
+		q_input_parts(q_input_parts),
+		hasher(hasher),
+		section(section),
+		packer(packer),
+		input_part_pool(input_part_pool)
+	{}
+
+	bool run()
+	{
+		input_part_t input_part;
+		vector<input_part_t> out_parts;
+		uint64_t priority;
+		uint64_t out_priority;
+		bool canceled = false;
+
+		while (!canceled && q_input_parts.pop(input_part, priority))
+		{
+			if (hasher)
+			{
+				CTraceSpan span("hash", priority, "input_part");
+				hasher->hash_part(input_part);
+			}
+
+			{
+				// Includes waiting for the turn of the part
+				CTraceSpan span("section", priority, "input_part");
+				if (!section.process(input_part, priority, out_parts, out_priority))
+					break;
+			}
+
+			// Items were moved out, but the vector is returned to the data source
+			if (input_part_pool)
+				input_part_pool->put(move(input_part));
+
+			for (auto& part : out_parts)
+				if (!packer.process(part, out_priority++))
+				{
+					canceled = true;
+					break;
+				}
+
+			out_parts.clear();
+		}
+
+		packer.mark_completed();
+
+		return !packer.is_failed();
+	}
+};
@@ -0,0 +1,329 @@
+#pragma once
+
+#include "params.h"
+
+#include <memory>
+#include <vector>
+#include <string>
+#include <algorithm>
+
+#include <refresh/compression/lib/gz_wrapper.h>
+#include <refresh/compression/lib/file_wrapper.h>
+
+using namespace std;
+
+// Interface of in-memory gzip compressors used by CPartPacker
+class CGzipCompressor
+{
+public:
+	virtual ~CGzipCompressor() = default;
+
+	virtual size_t compress_bound(size_t src_size) = 0;
+
+	// Returns size of compressed data or 0 on error
+	virtual size_t compress(const void* src, size_t src_size, void* dest, size_t dest_size, int level) = 0;
+
+	virtual string name() const = 0;
+};
+
+// **********************************************************************************
+class CGzipCompressorLibdeflate : public CGzipCompressor
+{
+	refresh::gz_in_memory gim;
+
+public:
+	CGzipCompressorLibdeflate(int level) :
+		gim(level)
+	{}
+
+	size_t compress_bound(size_t src_size) override
+	{
+		return src_size + gim.get_overhead(src_size);
+	}
+
+	size_t compress(const void* src, size_t src_size, void* dest, size_t dest_size, int level) override
+	{
+		return gim.compress(src, src_size, dest, dest_size, level);
+	}
+
+	string name() const override
+	{
+		return "libdeflate";
+	}
+};
+
+#ifdef REFRESH_STREAM_DECOMPRESSION_ENABLE_IGZIP
+// **********************************************************************************
+// isa-l supports only levels 0-3, but is much faster than other engines for them
+class CGzipCompressorIsal : public CGzipCompressor
+{
+	vector<uint8_t> level_buf;
+
+	static int isal_level(int level)
+	{
+		return std::clamp(level, 0, ISAL_DEF_MAX_LEVEL);
+	}
+
+	static size_t level_buf_size(int isal_level)
+	{
+		switch (isal_level)
+		{
+		case 1: return ISAL_DEF_LVL1_DEFAULT;
+		case 2: return ISAL_DEF_LVL2_DEFAULT;
+		case 3: return ISAL_DEF_LVL3_DEFAULT;
+		default: return 0;
+		}
+	}
+
+public:
+	CGzipCompressorIsal() = default;
+
+	size_t compress_bound(size_t src_size) override
+	{
+		return src_size + (src_size >> 4) + 1024;
+	}
+
+	size_t compress(const void* src, size_t src_size, void* dest, size_t dest_size, int level) override
+	{
+		isal_zstream stream;
+		int i_level = isal_level(level);
+
+		isal_deflate_init(&stream);
+
+		level_buf.resize(level_buf_size(i_level));
+
+		stream.gzip_flag = IGZIP_GZIP;
+		stream.level = (uint32_t) i_level;
+		stream.level_buf = level_buf.empty() ? nullptr : level_buf.data();
+		stream.level_buf_size = (uint32_t) level_buf.size();
+		stream.flush = NO_FLUSH;
+
+		const uint8_t* in_ptr = (const uint8_t*) src;
+		size_t in_left = src_size;
+		uint8_t* out_ptr = (uint8_t*) dest;
+		size_t out_left = dest_size;
+
+		// isa-l uses 32-bit sizes, so large inputs are passed in chunks
+		const size_t max_chunk = 1u << 30;
+
+		do
+		{
+			uint32_t in_chunk = (uint32_t) std::min(in_left, max_chunk);
+			uint32_t out_chunk = (uint32_t) std::min(out_left, max_chunk);
+
+			stream.next_in = (uint8_t*) in_ptr;
+			stream.avail_in = in_chunk;
+			stream.next_out = out_ptr;
+			stream.avail_out = out_chunk;
+			stream.end_of_stream = in_chunk == in_left;
+
+			if (isal_deflate(&stream) != COMP_OK)
+				return 0;
+
+			in_ptr += in_chunk - stream.avail_in;
+			in_left -= in_chunk - stream.avail_in;
+			out_ptr += out_chunk - stream.avail_out;
+			out_left -= out_chunk - stream.avail_out;
+
+			if (stream.avail_out == 0 && out_left == 0 && stream.internal_state.state != ZSTATE_END)
+				return 0;
+		} while (stream.internal_state.state != ZSTATE_END);
+
+		return dest_size - out_left;
+	}
+
+	string name() const override
+	{
+		return "isa-l";
+	}
+};
+#endif
+
+#ifdef REFRESH_STREAM_DECOMPRESSION_ENABLE_ZLIB
+// **********************************************************************************
+class CGzipCompressorZlib : public CGzipCompressor
+{
+	int level;
+
+public:
+	CGzipCompressorZlib(int level) :
+		level(std::clamp(level, 1, 9))
+	{}
+
+	// Bound of the library (zlib-ng uses a different algorithm for level 1, which can need more space)
+	static size_t deflate_bound(int level, size_t src_size)
+	{
+		z_stream stream{};
+
+		if (deflateInit2(&stream, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+			return 0;
+
+		size_t r = deflateBound(&stream, (uLong) src_size);
+		deflateEnd(&stream);
+
+		return r;
+	}
+
+	size_t compress_bound(size_t src_size) override
+	{
+		// Level can be changed for each call (adaptive compression)
+		return std::max(deflate_bound(1, src_size), deflate_bound(9, src_size));
+	}
+
+	size_t compress(const void* src, size_t src_size, void* dest, size_t dest_size, int _level) override
+	{
+		z_stream stream{};
+
+		if (deflateInit2(&stream, std::clamp(_level, 1, 9), Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+			return 0;
+
+		// zlib uses 32-bit sizes, so large inputs are passed in chunks
+		const size_t max_chunk = 1u << 30;
+		const uint8_t* in_ptr = (const uint8_t*)src;
+		size_t in_left = src_size;
+		uint8_t* out_ptr = (uint8_t*)dest;
+		size_t out_left = dest_size;
+		int ret;
+
+		do
+		{
+			uInt in_chunk = (uInt) std::min(in_left, max_chunk);
+			uInt out_chunk = (uInt) std::min(out_left, max_chunk);
+
+			stream.next_in = (Bytef*) in_ptr;
+			stream.avail_in = in_chunk;
+			stream.next_out = out_ptr;
+			stream.avail_out = out_chunk;
+
+			ret = deflate(&stream, in_chunk == in_left ? Z_FINISH : Z_NO_FLUSH);
+
+			in_ptr += in_chunk - stream.avail_in;
+			in_left -= in_chunk - stream.avail_in;
+			out_ptr += out_chunk - stream.avail_out;
+			out_left -= out_chunk - stream.avail_out;
+
+			if (ret == Z_STREAM_ERROR || (ret == Z_BUF_ERROR && out_left == 0))
+			{
+				deflateEnd(&stream);
+				return 0;
+			}
+		} while (ret != Z_STREAM_END);
+
+		deflateEnd(&stream);
+
+		return dest_size - out_left;
+	}
+
+	string name() const override
+	{
+		return "zlib-ng";
+	}
+};
+#endif
+
+// **********************************************************************************
+// Picks the fastest available engine for the level of each call
+class CGzipCompressorAuto : public CGzipCompressor
+{
+	const int max_isal_level = 3;
+
+	unique_ptr<CGzipCompressor> comp_libdeflate;
+	unique_ptr<CGzipCompressor> comp_fast;
+
+	CGzipCompressor* select(int level)
+	{
+		return (comp_fast && level <= max_isal_level) ? comp_fast.get() : comp_libdeflate.get();
+	}
+
+public:
+	CGzipCompressorAuto(int level)
+	{
+		comp_libdeflate = make_unique<CGzipCompressorLibdeflate>(level);
+#ifdef REFRESH_STREAM_DECOMPRESSION_ENABLE_IGZIP
+		comp_fast = make_unique<CGzipCompressorIsal>();
+#endif
+	}
+
+	size_t compress_bound(size_t src_size) override
+	{
+		size_t r = comp_libdeflate->compress_bound(src_size);
+
+		if (comp_fast)
+			r = std::max(r, comp_fast->compress_bound(src_size));
+
+		return r;
+	}
+
+	size_t compress(const void* src, size_t src_size, void* dest, size_t dest_size, int level) override
+	{
+		return select(level)->compress(src, src_size, dest, dest_size, level);
+	}
+
+	string name() const override
+	{
+		return comp_fast ? "auto (" + comp_fast->name() + " for levels 1-3, " + comp_libdeflate->name() + " for others)" : "auto (" + comp_libdeflate->name() + ")";
+	}
+};
+
+// **********************************************************************************
+inline bool gzip_engine_available(CParams::gzip_engine_t engine)
+{
+	switch (engine)
+	{
+	case CParams::gzip_engine_t::auto_select:
+	case CParams::gzip_engine_t::libdeflate:
+		return true;
+	case CParams::gzip_engine_t::isal:
+#ifdef REFRESH_STREAM_DECOMPRESSION_ENABLE_IGZIP
+		return true;
+#else
+		return false;
+#endif
+	case CParams::gzip_engine_t::zlib_ng:
+#ifdef REFRESH_STREAM_DECOMPRESSION_ENABLE_ZLIB
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	return false;
+}
+
+// **********************************************************************************
+// Range of compression levels supported by the engine used for the output format (bgzf is always made by libdeflate)
+inline pair<int, int> gzip_level_range(CParams::gzip_engine_t engine, CParams::output_format_t output_format)
+{
+	if (output_format == CParams::output_format_t::gzip)
+		switch (engine)
+		{
+		case CParams::gzip_engine_t::isal:
+			return make_pair(0, 3);
+		case CParams::gzip_engine_t::zlib_ng:
+			return make_pair(1, 9);
+		default:
+			break;
+		}
+
+	return make_pair(1, 12);
+}
+
+// **********************************************************************************
+inline unique_ptr<CGzipCompressor> make_gzip_compressor(CParams::gzip_engine_t engine, int level)
+{
+	switch (engine)
+	{
+#ifdef REFRESH_STREAM_DECOMPRESSION_ENABLE_IGZIP
+	case CParams::gzip_engine_t::isal:
+		return make_unique<CGzipCompressorIsal>();
+#endif
+#ifdef REFRESH_STREAM_DECOMPRESSION_ENABLE_ZLIB
+	case CParams::gzip_engine_t::zlib_ng:
+		return make_unique<CGzipCompressorZlib>(level);
+#endif
+	case CParams::gzip_engine_t::libdeflate:
+		return make_unique<CGzipCompressorLibdeflate>(level);
+	default:
+		return make_unique<CGzipCompressorAuto>(level);
+	}
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
+// Allocator placing large blocks (at least huge_page_size) in separate mappings aligned to huge pages
+// and advised to be backed by transparent huge pages. Smaller blocks are allocated as usual.
+template<typename T>
+class huge_page_allocator
+{
+public:
+	using value_type = T;
+
+	static constexpr size_t huge_page_size = 2 << 20;
+
+	huge_page_allocator() noexcept = default;
+
+	template<typename U>
+	huge_page_allocator(const huge_page_allocator<U>&) noexcept
+	{}
+
+	T* allocate(size_t n)
+	{
+		size_t bytes = n * sizeof(T);
+
+#ifndef _WIN32
+		if (bytes >= huge_page_size)
+		{
+			size_t rounded = round_up(bytes);
+			size_t len = rounded + huge_page_size;
+
+			void* raw = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (raw == MAP_FAILED)
+				throw std::bad_alloc();
+
+			// Trim the mapping to the huge page boundaries
+			uintptr_t raw_addr = (uintptr_t)raw;
+			uintptr_t addr = (raw_addr + huge_page_size - 1) & ~(uintptr_t)(huge_page_size - 1);
+
+			if (addr > raw_addr)
+				munmap(raw, addr - raw_addr);
+			if (raw_addr + len > addr + rounded)
+				munmap((void*)(addr + rounded), raw_addr + len - (addr + rounded));
+
+#ifdef MADV_HUGEPAGE
+			madvise((void*)addr, rounded, MADV_HUGEPAGE);
+#endif
+
+			return (T*)addr;
+		}
+#endif
+
+		return static_cast<T*>(::operator new(bytes));
+	}
+
+	void deallocate(T* p, size_t n) noexcept
+	{
+#ifndef _WIN32
+		size_t bytes = n * sizeof(T);
+
+		if (bytes >= huge_page_size)
+		{
+			munmap((void*)p, round_up(bytes));
+			return;
+		}
+#endif
+
+		::operator delete(p);
+	}
+
+	template<typename U>
+	bool operator==(const huge_page_allocator<U>&) const noexcept
+	{
+		return true;
+	}
+
+	template<typename U>
+	bool operator!=(const huge_page_allocator<U>&) const noexcept
+	{
+		return false;
+	}
+
+private:
+	static size_t round_up(size_t bytes)
+	{
+		return (bytes + huge_page_size - 1) / huge_page_size * huge_page_size;
+	}
+};
@@ -0,0 +1,275 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <functional>
+#include <atomic>
+#include <cinttypes>
+
+#include "defs.h"
+#include "utils.h"
+#include "trace.h"
+#include "progress.h"
+
+#include <refresh/parallel_queues/lib/parallel-queues.h>
+
+using namespace std;
+using namespace refresh;
+
+// Set of sequence identifiers. Ids are stored in a single buffer and looked up in an open addressing table of their indices,
+// so the set takes a few bytes per id over its length (100k accessions take a few MB).
+class CIdSet
+{
+	string ids;							// concatenated ids
+	vector<uint64_t> offsets{ 0 };		// i-th id is in [offsets[i], offsets[i + 1])
+	vector<uint32_t> table;				// index of id + 1, 0 - empty slot
+	size_t mask = 0;
+	vector<uint8_t> found;
+	size_t no_found = 0;
+
+	string_view get(size_t i) const
+	{
+		return string_view(ids.data() + offsets[i], offsets[i + 1] - offsets[i]);
+	}
+
+	// Returns slot of the id or of the empty slot where it should be placed
+	size_t find_slot(string_view id) const
+	{
+		size_t pos = std::hash<string_view>{}(id) & mask;
+
+		while (table[pos] && get(table[pos] - 1) != id)
+			pos = (pos + 1) & mask;
+
+		return pos;
+	}
+
+	void build_table()
+	{
+		size_t table_size = 16;
+		while (table_size < 2 * size())
+			table_size *= 2;
+
+		table.assign(table_size, 0);
+		mask = table_size - 1;
+
+		size_t no_unique = 0;
+
+		for (size_t i = 0; i < size(); ++i)
+		{
+			size_t pos = find_slot(get(i));
+			if (table[pos])
+				continue;				// the same id given more than once
+
+			// Ids are compacted, so indices of the table refer to unique ids only
+			string_view id = get(i);
+			size_t start = offsets[no_unique];
+			if (start != offsets[i])
+				copy(id.begin(), id.end(), ids.begin() + start);
+			offsets[no_unique + 1] = start + id.size();
+			++no_unique;
+
+			table[pos] = (uint32_t) no_unique;
+		}
+
+		ids.resize(offsets[no_unique]);
+		ids.shrink_to_fit();
+		offsets.resize(no_unique + 1);
+		offsets.shrink_to_fit();
+
+		found.assign(no_unique, 0);
+	}
+
+public:
+	// Reads ids, one per line; the line is cut with the same rules as FASTA headers (leading '>' is optional)
+	bool load(const string& fn)
+	{
+		ifstream ifs(fn);
+
+		if (!ifs)
+		{
+			std::cerr << "Cannot open file with ids: " << fn << endl;
+			return false;
+		}
+
+		string line;
+
+		while (getline(ifs, line))
+		{
+			if (!line.empty() && line.back() == '\r')
+				line.pop_back();
+
+			if (!line.empty() && line.front() == '>')
+				line.erase(0, 1);
+
+			line.resize(id_length(line));
+
+			if (line.empty())
+				continue;
+
+			ids.append(line);
+			offsets.emplace_back(ids.size());
+		}
+
+		if (offsets.size() - 1 >= UINT32_MAX)
+		{
+			std::cerr << "Too many ids in file: " << fn << endl;
+			return false;
+		}
+
+		build_table();
+
+		return true;
+	}
+
+	size_t size() const
+	{
+		return offsets.size() - 1;
+	}
+
+	// Index of the id or -1 if the id is absent
+	int64_t find(string_view id) const
+	{
+		if (table.empty())
+			return -1;
+
+		return (int64_t) table[find_slot(id)] - 1;
+	}
+
+	// Returns true if the id was not found before
+	bool mark_found(size_t i)
+	{
+		if (found[i])
+			return false;
+
+		found[i] = 1;
+		++no_found;
+
+		return true;
+	}
+
+	size_t get_no_found() const
+	{
+		return no_found;
+	}
+
+	bool all_found() const
+	{
+		return no_found == size();
+	}
+
+	vector<string> get_missing() const
+	{
+		vector<string> r;
+
+		for (size_t i = 0; i < size(); ++i)
+			if (!found[i])
+				r.emplace_back(get(i));
+
+		return r;
+	}
+
+	size_t footprint() const
+	{
+		return ids.capacity() + offsets.capacity() * sizeof(uint64_t) + table.capacity() * sizeof(uint32_t) + found.capacity();
+	}
+};
+
+// Keeps records with identifiers from the set. Parts must be given in order if the reading is stopped when all ids are found,
+// so the same records are extracted in each run; the rest of parts read before the data source stops is dropped.
+class CIdFilter
+{
+	parallel_priority_queue<input_part_t>& q_input_parts;
+	parallel_priority_queue<input_part_t>& q_filtered_parts;
+	CIdSet& id_set;
+	bool stop_early;
+	atomic<bool>* stop_reading;
+	CProgress* progress;
+
+	size_t no_records = 0;				// scanned before all ids are found (in early stop mode)
+	size_t no_extracted = 0;
+
+	bool is_stopped() const
+	{
+		return stop_early && id_set.all_found();
+	}
+
+public:
+	CIdFilter(parallel_priority_queue<input_part_t>& q_input_parts, parallel_priority_queue<input_part_t>& q_filtered_parts, CIdSet& id_set,
+		bool stop_early = false, atomic<bool>* stop_reading = nullptr, CProgress* progress = nullptr) :
+		q_input_parts(q_input_parts),
+		q_filtered_parts(q_filtered_parts),
+		id_set(id_set),
+		stop_early(stop_early),
+		stop_reading(stop_reading),
+		progress(progress)
+	{}
+
+	void filter(input_part_t& input_part)
+	{
+		size_t no_items = input_part.size();
+		size_t no_kept = 0;
+
+		if (!is_stopped())
+		{
+			size_t i;
+
+			for (i = 0; i < input_part.size() && !is_stopped(); ++i)
+			{
+				const string& header = input_part[i].id;
+				int64_t idx = id_set.find(string_view(header).substr(1, id_length(header) - 1));
+
+				if (idx < 0)
+					continue;
+
+				id_set.mark_found(idx);
+
+				if (no_kept != i)
+					swap(input_part[no_kept], input_part[i]);
+				++no_kept;
+			}
+
+			no_records += i;
+		}
+
+		input_part.erase(input_part.begin() + no_kept, input_part.end());
+		no_extracted += no_kept;
+
+		if (progress)
+			progress->add_filtered(no_items, no_items - input_part.size());
+
+		if (is_stopped() && stop_reading)
+			stop_reading->store(true);
+	}
+
+	bool run()
+	{
+		input_part_t input_part;
+		uint64_t priority;
+
+		// Parts read after all ids are found are still passed (empty), as the output queue expects all priorities
+		while (q_input_parts.pop(input_part, priority))
+		{
+			{
+				CTraceSpan span("filter", priority, "input_part");
+				filter(input_part);
+			}
+
+			if (!q_filtered_parts.push_or_cancel(priority, move(input_part)))
+				break;
+		}
+
+		q_filtered_parts.mark_completed();
+
+		return true;
+	}
+
+	void get_stats(size_t& _no_records, size_t& _no_extracted)
+	{
+		_no_records = no_records;
+		_no_extracted = no_extracted;
+	}
+};
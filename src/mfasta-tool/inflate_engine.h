@@ -0,0 +1,186 @@
+#pragma once
+
+#include "params.h"
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdio>
+#include <algorithm>
+
+#include <refresh/compression/lib/file_wrapper.h>
+
+using namespace std;
+using namespace refresh;
+
+// Input stream serving a single in-memory block (sample of a file used for calibration)
+class CMemoryInStream : public stream_in_base
+{
+	string file_name;
+	vector<char>& data;
+	bool served = false;
+
+public:
+	CMemoryInStream(const string& file_name, vector<char>& data) :
+		file_name(file_name),
+		data(data)
+	{}
+
+	std::pair<char*, size_t> read() override
+	{
+		if (served)
+			return make_pair(nullptr, 0);
+
+		served = true;
+
+		return make_pair(data.data(), data.size());
+	}
+
+	void release(char*) override
+	{}
+
+	string get_file_name() const override
+	{
+		return file_name;
+	}
+};
+
+// **********************************************************************************
+inline bool inflate_engine_available(CParams::inflate_engine_t engine)
+{
+	switch (engine)
+	{
+	case CParams::inflate_engine_t::isal:
+		return stream_decompression::is_gzip_engine_available(stream_decompression::gzip_engine_t::igzip);
+	case CParams::inflate_engine_t::zlib_ng:
+		return stream_decompression::is_gzip_engine_available(stream_decompression::gzip_engine_t::zlib);
+	default:
+		return true;
+	}
+}
+
+// **********************************************************************************
+inline string inflate_engine_name(stream_decompression::gzip_engine_t engine)
+{
+	switch (engine)
+	{
+	case stream_decompression::gzip_engine_t::igzip:
+		return "isa-l";
+	case stream_decompression::gzip_engine_t::zlib:
+		return "zlib-ng";
+	default:
+		return stream_decompression::is_gzip_engine_available(stream_decompression::gzip_engine_t::igzip) ? "isa-l" : "zlib-ng";
+	}
+}
+
+// Chooses gzip decompression engine. In auto mode, if both engines are compiled in, the first few MB of the first gzipped input
+// are decompressed by each engine and the faster one is used for all inputs (relative speed depends on the CPU, not on the file).
+class CInflateEngineSelector
+{
+	CParams::inflate_engine_t mode;
+	size_t sample_size;
+	bool calibrated = false;
+	stream_decompression::gzip_engine_t selected = stream_decompression::gzip_engine_t::any;
+	string report;
+
+	// Returns decompression time or a negative value if the sample cannot be decompressed
+	static double measure(const string& file_name, vector<char>& sample, stream_decompression::gzip_engine_t engine)
+	{
+		const size_t chunk_size = 1 << 20;
+		vector<char> out(chunk_size);
+		size_t readed;
+
+		auto t_start = chrono::steady_clock::now();
+
+		CMemoryInStream in(file_name, sample);
+		stream_decompression sd(&in, chunk_size, engine);
+
+		if (sd.get_format() != stream_decompression::format_t::gzip)
+			return -1;
+
+		// Sample ends in the middle of the stream, so reading stops with an error code at its end
+		while (!sd.eof())
+			sd.read(out.data(), out.size(), readed);
+
+		return chrono::duration<double>(chrono::steady_clock::now() - t_start).count();
+	}
+
+	void calibrate(const string& file_name)
+	{
+		FILE* f = fopen(file_name.c_str(), "rb");
+
+		if (!f)
+			return;
+
+		// Only gzipped inputs are sampled, so for other inputs just their first bytes are read
+		unsigned char magic[2];
+
+		if (fread(magic, 1, 2, f) != 2 || magic[0] != 0x1f || magic[1] != 0x8b)
+		{
+			fclose(f);
+			return;
+		}
+
+		rewind(f);
+
+		vector<char> sample(sample_size);
+		sample.resize(fread(sample.data(), 1, sample.size(), f));
+		fclose(f);
+
+		// Best of a few runs, so the first (cold) run does not decide
+		double t_igzip = 1e30, t_zlib = 1e30;
+
+		for (int i = 0; i < 2; ++i)
+		{
+			double t1 = measure(file_name, sample, stream_decompression::gzip_engine_t::igzip);
+			double t2 = measure(file_name, sample, stream_decompression::gzip_engine_t::zlib);
+
+			if (t1 < 0 || t2 < 0)
+				return;									// not a gzip file, calibration is made on the next input
+
+			t_igzip = std::min(t_igzip, t1);
+			t_zlib = std::min(t_zlib, t2);
+		}
+
+		selected = t_igzip <= t_zlib ? stream_decompression::gzip_engine_t::igzip : stream_decompression::gzip_engine_t::zlib;
+		calibrated = true;
+
+		report = inflate_engine_name(selected) + " (calibrated on " + to_string(sample.size() >> 20) + " MB: isa-l " + to_string((int)(t_igzip * 1000))
+			+ " ms, zlib-ng " + to_string((int)(t_zlib * 1000)) + " ms)";
+	}
+
+public:
+	CInflateEngineSelector(CParams::inflate_engine_t mode, size_t sample_size = 8 << 20) :
+		mode(mode),
+		sample_size(sample_size)
+	{
+		if (mode == CParams::inflate_engine_t::isal)
+			selected = stream_decompression::gzip_engine_t::igzip;
+		else if (mode == CParams::inflate_engine_t::zlib_ng)
+			selected = stream_decompression::gzip_engine_t::zlib;
+
+		// Nothing to choose from
+		if (mode != CParams::inflate_engine_t::auto_select
+			|| !stream_decompression::is_gzip_engine_available(stream_decompression::gzip_engine_t::igzip)
+			|| !stream_decompression::is_gzip_engine_available(stream_decompression::gzip_engine_t::zlib))
+		{
+			calibrated = true;
+			report = inflate_engine_name(selected);
+		}
+	}
+
+	// Engine for the given input file (calibration is made once, on the first gzipped file)
+	stream_decompression::gzip_engine_t get(const string& file_name)
+	{
+		if (!calibrated)
+			calibrate(file_name);
+
+		return selected;
+	}
+
+	// Chosen engine (with calibration results); empty if no gzipped input was calibrated in auto mode
+	string get_report() const
+	{
+		return report;
+	}
+};
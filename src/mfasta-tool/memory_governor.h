@@ -0,0 +1,64 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+using namespace std;
+
+// Global limit of memory used by parts waiting in queues.
+// Queues add footprints of their items to in_queues; the data source waits for room before reading more data.
+class CMemoryGovernor
+{
+	size_t max_bytes;
+	atomic<size_t> in_queues{ 0 };
+	atomic<size_t> peak_in_queues{ 0 };
+	atomic<uint64_t> throttled_ns{ 0 };
+	atomic<bool> canceled{ false };
+
+public:
+	CMemoryGovernor(size_t max_bytes) :
+		max_bytes(max_bytes)
+	{}
+
+	atomic<size_t>* get_counter()
+	{
+		return &in_queues;
+	}
+
+	size_t get_max_bytes() const
+	{
+		return max_bytes;
+	}
+
+	// Canceled queues drop their items without releasing footprints, so waiting must end on cancellation
+	void cancel()
+	{
+		canceled = true;
+	}
+
+	// Queues do not notify the governor, so the (only) reading thread just polls the counter
+	void wait_for_room()
+	{
+		size_t curr = in_queues.load();
+
+		if (curr > peak_in_queues.load())
+			peak_in_queues = curr;
+
+		if (curr < max_bytes)
+			return;
+
+		auto t_start = chrono::high_resolution_clock::now();
+
+		while (in_queues.load() >= max_bytes && !canceled)
+			this_thread::sleep_for(chrono::milliseconds(1));
+
+		throttled_ns += chrono::duration_cast<chrono::nanoseconds>(chrono::high_resolution_clock::now() - t_start).count();
+	}
+
+	void get_stats(size_t& _peak_in_queues, double& throttled_time)
+	{
+		_peak_in_queues = peak_in_queues;
+		throttled_time = throttled_ns / 1e9;
+	}
+};
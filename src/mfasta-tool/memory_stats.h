@@ -0,0 +1,130 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <cinttypes>
+
+using namespace std;
+
+// Current and peak value of a counter shared by threads (bytes or no. of items)
+class CMemoryCounter
+{
+	atomic<int64_t> current{ 0 };
+	atomic<int64_t> peak{ 0 };
+
+	void update_peak(int64_t value)
+	{
+		int64_t old_peak = peak.load(memory_order_relaxed);
+
+		while (value > old_peak && !peak.compare_exchange_weak(old_peak, value, memory_order_relaxed))
+			;
+	}
+
+public:
+	void add(int64_t delta)
+	{
+		update_peak(current.fetch_add(delta, memory_order_relaxed) + delta);
+	}
+
+	// For counters with a single writer
+	void set(int64_t value)
+	{
+		current.store(value, memory_order_relaxed);
+		update_peak(value);
+	}
+
+	int64_t get_current() const
+	{
+		return current.load(memory_order_relaxed);
+	}
+
+	int64_t get_peak() const
+	{
+		return peak.load(memory_order_relaxed);
+	}
+};
+
+// Memory used by components of the pipeline. Components update explicit counters (once per part or buffer change),
+// so values are estimates of the data held by the pipeline, not of the allocator state.
+// Peaks of queued bytes are taken from the queues after processing.
+class CMemoryStats
+{
+	vector<pair<string, size_t>> queue_peaks;
+
+public:
+	// Peak resident set size of the process (0 if unknown)
+	static size_t read_peak_rss()
+	{
+#ifdef __linux__
+		ifstream ifs("/proc/self/status");
+		string line;
+
+		while (getline(ifs, line))
+			if (line.compare(0, 6, "VmHWM:") == 0)
+				return stoull(line.substr(6)) << 10;
+#endif
+		return 0;
+	}
+
+	CMemoryCounter decompression_buffers;		// buffers of opened input files (reading and decompression)
+	CMemoryCounter spare_lines;					// line buffers kept by the data source for reuse
+	CMemoryCounter dict_bytes;					// dictionary of sequence hashes (duplicates removal)
+	CMemoryCounter dict_entries;
+	CMemoryCounter packer_buffers;				// serialized and compressed parts held by packers
+	CMemoryCounter recycled_parts;				// emptied input and packed parts kept in recycle pools
+
+	void add_queue_peak(const string& name, size_t peak_bytes)
+	{
+		queue_peaks.emplace_back(name, peak_bytes);
+	}
+
+	// Upper bound of the memory used by the pipeline (peaks of components do not have to be simultaneous)
+	size_t sum_of_peaks() const
+	{
+		size_t r = decompression_buffers.get_peak() + spare_lines.get_peak() + dict_bytes.get_peak() + packer_buffers.get_peak() + recycled_parts.get_peak();
+
+		for (const auto& x : queue_peaks)
+			r += x.second;
+
+		return r;
+	}
+
+	void print(ostream& os) const
+	{
+		os << "Peak memory (MB)   : decompression " << (decompression_buffers.get_peak() >> 20) << ", spare lines " << (spare_lines.get_peak() >> 20)
+			<< ", dictionary " << (dict_bytes.get_peak() >> 20) << " (" << dict_entries.get_peak() << " entries), packers " << (packer_buffers.get_peak() >> 20)
+			<< ", recycled parts " << (recycled_parts.get_peak() >> 20) << endl;
+
+		if (!queue_peaks.empty())
+		{
+			os << "Peak queued (MB)   :";
+			for (const auto& x : queue_peaks)
+				os << " " << x.first << " " << (x.second >> 20);
+			os << endl;
+		}
+
+		os << "Sum of peaks       : " << (sum_of_peaks() >> 20) << " MB (peak RSS " << (read_peak_rss() >> 20) << " MB)" << endl;
+	}
+
+	// Writes JSON object (without trailing newline)
+	void write_json(ostream& os, const string& indent) const
+	{
+		os << "{\n";
+		os << indent << "  \"decompression_buffers_bytes\": " << decompression_buffers.get_peak() << ",\n";
+		os << indent << "  \"spare_lines_bytes\": " << spare_lines.get_peak() << ",\n";
+		os << indent << "  \"dict_bytes\": " << dict_bytes.get_peak() << ",\n";
+		os << indent << "  \"dict_entries\": " << dict_entries.get_peak() << ",\n";
+		os << indent << "  \"packer_buffers_bytes\": " << packer_buffers.get_peak() << ",\n";
+		os << indent << "  \"recycled_parts_bytes\": " << recycled_parts.get_peak() << ",\n";
+		os << indent << "  \"queued_bytes\": {";
+		for (size_t i = 0; i < queue_peaks.size(); ++i)
+			os << (i ? ", " : "") << "\"" << queue_peaks[i].first << "\": " << queue_peaks[i].second;
+		os << "},\n";
+		os << indent << "  \"sum_of_peaks_bytes\": " << sum_of_peaks() << ",\n";
+		os << indent << "  \"peak_rss_bytes\": " << read_peak_rss() << "\n";
+		os << indent << "}";
+	}
+};
@@ -3,13 +3,13 @@
 #include <cstring>
 #include <thread>
 #include <atomic>
+#include <memory>
 
 #include "params.h"
-#include "data_source.h"
-#include "data_storer.h"
-#include "data_partitioner.h"
-#include "sha256_filter.h"
-#include "part_packer.h"
+#include "gzip_compressor.h"
+#include "inflate_engine.h"
+#include "mrds.h"
+#include "stats.h"
 
 using namespace std;
 
@@ -21,8 +21,8 @@ CParams params;
 // *****************************************************************************************
 bool parse_mode(int argc, char** argv);
 bool parse_args_mrds(int argc, char** argv);
+bool parse_args_stats(int argc, char** argv);
 void usage();
-bool process_mrds();
 vector<string> split(const string& str, char sep);
 
 // ****************************************************************************
@@ -67,16 +67,32 @@ bool parse_mode(int argc, char** argv)
 
 	if (argv[1] == "mrds"s)
 		params.working_mode = CParams::working_mode_t::mrds;
+	else if (argv[1] == "stats"s)
+		params.working_mode = CParams::working_mode_t::stats;
+	else if (argv[1] == "extract"s)
+		params.working_mode = CParams::working_mode_t::extract;
 
 	return params.working_mode != CParams::working_mode_t::none;
 }
 
 // *****************************************************************************************
+// Used also in extract mode, which shares output options
 bool parse_args_mrds(int argc, char **argv)
 {
+	bool extract = params.working_mode == CParams::working_mode_t::extract;
+
 	for (int i = 2; i < argc; ++i)
 	{
-		if ((argv[i] == "-n"s || argv[i] == "--part-size"s) && i + 1 < argc)
+		if (extract && argv[i] == "--ids"s && i + 1 < argc)
+		{
+			params.extract_ids = argv[i + 1];
+			++i;
+		}
+		else if (extract && argv[i] == "--stop-early"s)
+		{
+			params.stop_early = true;
+		}
+		else if ((argv[i] == "-n"s || argv[i] == "--part-size"s) && i + 1 < argc)
 		{
 			params.n = atoi(argv[i + 1]);
 			++i;
@@ -84,10 +100,64 @@ bool parse_args_mrds(int argc, char **argv)
 		else if ((argv[i] == "-t"s || argv[i] == "--no-threads"s) && i + 1 < argc)
 		{
 			params.no_threads = atoi(argv[i + 1]);
-			if(params.no_threads < 3)
+			if (params.no_threads < 0)
+				params.no_threads = 0;
+			else if(params.no_threads > 0 && params.no_threads < 3)
 				params.no_threads = 3;
 			++i;
 		}
+		else if (argv[i] == "--pin-threads"s)
+		{
+			params.pin_threads = true;
+		}
+		else if (argv[i] == "--dynamic-scheduling"s)
+		{
+			params.dynamic_scheduling = true;
+		}
+		else if (argv[i] == "--fused"s)
+		{
+			params.fused = true;
+		}
+		else if (argv[i] == "--profile"s && i + 1 < argc)
+		{
+			params.profile = argv[i + 1];
+			++i;
+		}
+		else if (argv[i] == "--trace"s && i + 1 < argc)
+		{
+			params.trace = argv[i + 1];
+			++i;
+		}
+		else if (argv[i] == "--progress"s && i + 1 < argc)
+		{
+			params.progress_interval = atof(argv[i + 1]);
+			++i;
+		}
+		else if (argv[i] == "--progress-format"s && i + 1 < argc)
+		{
+			if (argv[i + 1] == "text"s)
+				params.progress_json = false;
+			else if (argv[i + 1] == "json"s)
+				params.progress_json = true;
+			else
+			{
+				std::cerr << "Unknown progress format: " << argv[i + 1] << endl;
+				return false;
+			}
+			++i;
+		}
+		else if (argv[i] == "--storer-threads"s && i + 1 < argc)
+		{
+			params.no_storer_threads = atoi(argv[i + 1]);
+			if (params.no_storer_threads < 1)
+				params.no_storer_threads = 1;
+			++i;
+		}
+		else if (argv[i] == "--max-memory"s && i + 1 < argc)
+		{
+			params.max_memory = (size_t) atoll(argv[i + 1]);
+			++i;
+		}
 		else if ((argv[i] == "-o"s || argv[i] == "--out-name"s) && i + 1 < argc)
 		{
 			params.out_name = argv[i + 1];
@@ -105,13 +175,127 @@ bool parse_args_mrds(int argc, char **argv)
 		}
 		else if (argv[i] == "--gzipped-output"s)
 		{
-			params.gzipped_output = true;
+			params.output_format = CParams::output_format_t::gzip;
+		}
+		else if (argv[i] == "--output-format"s && i + 1 < argc)
+		{
+			if (argv[i + 1] == "plain"s)
+				params.output_format = CParams::output_format_t::plain;
+			else if (argv[i + 1] == "gzip"s)
+				params.output_format = CParams::output_format_t::gzip;
+			else if (argv[i + 1] == "bgzf"s)
+				params.output_format = CParams::output_format_t::bgzf;
+			else if (argv[i + 1] == "zstd"s)
+			{
+#ifdef REFRESH_USE_ZSTD
+				params.output_format = CParams::output_format_t::zstd;
+#else
+				std::cerr << "zstd output is not supported by this build (zstd is taken from 3rd_party/zstd or the system libzstd at build time)" << endl;
+				return false;
+#endif
+			}
+			else
+			{
+				std::cerr << "Unknown output format: " << argv[i + 1] << endl;
+				return false;
+			}
+			++i;
 		}
 		else if (argv[i] == "--gzip-level"s && i + 1 < argc)
 		{
 			params.gzip_level = atoi(argv[i + 1]);
 			++i;
 		}
+		else if (argv[i] == "--gzip-engine"s && i + 1 < argc)
+		{
+			if (argv[i + 1] == "auto"s)
+				params.gzip_engine = CParams::gzip_engine_t::auto_select;
+			else if (argv[i + 1] == "libdeflate"s)
+				params.gzip_engine = CParams::gzip_engine_t::libdeflate;
+			else if (argv[i + 1] == "isa-l"s)
+				params.gzip_engine = CParams::gzip_engine_t::isal;
+			else if (argv[i + 1] == "zlib-ng"s)
+				params.gzip_engine = CParams::gzip_engine_t::zlib_ng;
+			else
+			{
+				std::cerr << "Unknown gzip engine: " << argv[i + 1] << endl;
+				return false;
+			}
+
+			if (!gzip_engine_available(params.gzip_engine))
+			{
+				std::cerr << "gzip engine " << argv[i + 1] << " is not supported by this build" << endl;
+				return false;
+			}
+			++i;
+		}
+		else if (argv[i] == "--inflate-engine"s && i + 1 < argc)
+		{
+			if (argv[i + 1] == "auto"s)
+				params.inflate_engine = CParams::inflate_engine_t::auto_select;
+			else if (argv[i + 1] == "isa-l"s)
+				params.inflate_engine = CParams::inflate_engine_t::isal;
+			else if (argv[i + 1] == "zlib-ng"s)
+				params.inflate_engine = CParams::inflate_engine_t::zlib_ng;
+			else
+			{
+				std::cerr << "Unknown inflate engine: " << argv[i + 1] << endl;
+				return false;
+			}
+
+			if (!inflate_engine_available(params.inflate_engine))
+			{
+				std::cerr << "inflate engine " << argv[i + 1] << " is not supported by this build" << endl;
+				return false;
+			}
+			++i;
+		}
+		else if (argv[i] == "--adaptive-gzip"s)
+		{
+			params.adaptive_gzip = true;
+		}
+		else if (argv[i] == "--gzip-min-level"s && i + 1 < argc)
+		{
+			params.gzip_min_level = atoi(argv[i + 1]);
+			++i;
+		}
+		else if (argv[i] == "--gzip-max-level"s && i + 1 < argc)
+		{
+			params.gzip_max_level = atoi(argv[i + 1]);
+			++i;
+		}
+		else if (argv[i] == "--gzip-block-size"s && i + 1 < argc)
+		{
+			params.gzip_block_size = (size_t) atoi(argv[i + 1]) << 20;
+			++i;
+		}
+		else if (argv[i] == "--zstd-level"s && i + 1 < argc)
+		{
+			params.zstd_level = atoi(argv[i + 1]);
+			++i;
+		}
+		else if (argv[i] == "--zstd-workers"s && i + 1 < argc)
+		{
+			params.zstd_workers = atoi(argv[i + 1]);
+			++i;
+		}
+		else if (argv[i] == "--zstd-seekable"s)
+		{
+			params.zstd_seekable = true;
+		}
+		else if (argv[i] == "--write-fai"s)
+		{
+			params.write_fai = true;
+		}
+		else if (argv[i] == "--unordered"s)
+		{
+			params.unordered = true;
+		}
+		else if (argv[i] == "--manifest"s && i + 1 < argc)
+		{
+			params.manifest = argv[i + 1];
+			++i;
+		}
 		else if (argv[i] == "--part-digits"s && i + 1 < argc)
 		{
 			params.part_digits = atoi(argv[i + 1]);
@@ -168,12 +352,51 @@ bool parse_args_mrds(int argc, char **argv)
 		return false;
 	}
 
+	if (extract)
+	{
+		if (params.extract_ids.empty())
+		{
+			std::cerr << "File with ids must be provided (--ids)" << endl;
+			return false;
+		}
+
+		if (params.remove_duplicates || params.fused || params.dynamic_scheduling)
+		{
+			std::cerr << "--remove-duplicates, --fused and --dynamic-scheduling cannot be used in extract mode" << endl;
+			return false;
+		}
+	}
+
 	if (params.out_name.empty() && params.n == 0)
 	{
 		std::cerr << "If you want to split the input you mut provide --part-size" << endl;
 		return 0;
 	}
 
+	if (params.write_fai && params.output_format != CParams::output_format_t::plain && params.output_format != CParams::output_format_t::bgzf)
+	{
+		std::cerr << "--write-fai can be used only with plain or bgzf output" << endl;
+		return false;
+	}
+
+	if (params.adaptive_gzip && (params.output_format == CParams::output_format_t::gzip || params.output_format == CParams::output_format_t::bgzf))
+	{
+		auto range = gzip_level_range(params.gzip_engine, params.output_format);
+
+		if (params.gzip_min_level < range.first || params.gzip_max_level > range.second || params.gzip_min_level > params.gzip_max_level)
+		{
+			std::cerr << "--gzip-min-level and --gzip-max-level must be in range " << range.first << "-" << range.second
+				<< " for the chosen engine and output format, with min. level not above max. level" << endl;
+			return false;
+		}
+	}
+
+	if (params.fused && params.dynamic_scheduling)
+	{
+		std::cerr << "--fused and --dynamic-scheduling cannot be used together" << endl;
+		return false;
+	}
+
 	if (params.in_prefixes.empty())
 		params.in_prefixes.resize(params.in_names.size());
 	else if (params.in_prefixes.size() != params.in_names.size())
@@ -185,6 +408,86 @@ bool parse_args_mrds(int argc, char **argv)
 	return true;
 }
 
+// *****************************************************************************************
+bool parse_args_stats(int argc, char** argv)
+{
+	for (int i = 2; i < argc; ++i)
+	{
+		if ((argv[i] == "-t"s || argv[i] == "--no-threads"s) && i + 1 < argc)
+		{
+			params.no_threads = atoi(argv[i + 1]);
+			if (params.no_threads < 0)
+				params.no_threads = 0;
+			++i;
+		}
+		else if ((argv[i] == "-o"s || argv[i] == "--out-name"s) && i + 1 < argc)
+		{
+			params.out_name = argv[i + 1];
+			++i;
+		}
+		else if (argv[i] == "--format"s && i + 1 < argc)
+		{
+			if (argv[i + 1] == "tsv"s)
+				params.stats_json = false;
+			else if (argv[i + 1] == "json"s)
+				params.stats_json = true;
+			else
+			{
+				std::cerr << "Unknown stats format: " << argv[i + 1] << endl;
+				return false;
+			}
+			++i;
+		}
+		else if (argv[i] == "--inflate-engine"s && i + 1 < argc)
+		{
+			if (argv[i + 1] == "auto"s)
+				params.inflate_engine = CParams::inflate_engine_t::auto_select;
+			else if (argv[i + 1] == "isa-l"s)
+				params.inflate_engine = CParams::inflate_engine_t::isal;
+			else if (argv[i + 1] == "zlib-ng"s)
+				params.inflate_engine = CParams::inflate_engine_t::zlib_ng;
+			else
+			{
+				std::cerr << "Unknown inflate engine: " << argv[i + 1] << endl;
+				return false;
+			}
+
+			if (!inflate_engine_available(params.inflate_engine))
+			{
+				std::cerr << "inflate engine " << argv[i + 1] << " is not supported by this build" << endl;
+				return false;
+			}
+			++i;
+		}
+		else if (argv[i] == "--verbosity"s && i + 1 < argc)
+		{
+			params.verbosity = atoi(argv[i + 1]);
+			++i;
+		}
+		else if ((argv[i] == "-i"s || argv[i] == "--in-names"s) && i + 1 < argc)
+		{
+			string fn_list = argv[i + 1];
+			++i;
+			params.in_names = split(fn_list, ',');
+		}
+		else
+		{
+			std::cerr << "Unknown option: " << argv[i] << endl;
+			return false;
+		}
+	}
+
+	if (params.in_names.empty())
+	{
+		std::cerr << "Input file name(s) must be provided\n";
+		return false;
+	}
+
+	params.in_prefixes.resize(params.in_names.size());
+
+	return true;
+}
+
 // *****************************************************************************************
 void usage()
 {
@@ -194,6 +497,8 @@ void usage()
 	std::cerr << "mfasta-tool <mode> [options]\n";
 	std::cerr << "Modes:\n";
 	std::cerr << "   mrds - merges a few input files with optional removal of duplicates and splitting into pieces of give size\n";
+	std::cerr << "   extract - extracts records with ids from the given list\n";
+	std::cerr << "   stats - reports no. of records, N50/L50, length histogram and base composition (GC content, Ns) of each input file and in total\n";
 }
 
 // *****************************************************************************************
@@ -208,12 +513,34 @@ void usage_mrds()
 	std::cerr << "   -o | --out-name <string>      - output name when no splitting is made (default: stdout)\n";
 	std::cerr << "   -i | --in-names <string>      - comma-separated list of input file names\n";
 	std::cerr << "   --in-prefixes <string>        - comma-separated list of prefixes for input file names (optional)\n";
-	std::cerr << "   -t | --no-threads <int>       - no. of threads (default: " << params.no_threads << ")\n";
+	std::cerr << "   -t | --no-threads <int>       - no. of threads; 0 - no. of available cores (respecting cgroup CPU quota) (default: " << params.no_threads << ")\n";
+	std::cerr << "   --pin-threads                 - pin threads to CPUs, filling NUMA nodes one by one (default: false)\n";
+	std::cerr << "   --dynamic-scheduling          - hashing and packing tasks are made by a shared pool of threads following the bottleneck (default: false)\n";
+	std::cerr << "   --fused                       - each part is hashed, filtered, partitioned and packed by a single worker of a shared pool (default: false)\n";
+	std::cerr << "   --storer-threads <int>        - no. of threads writing output parts in parallel (default: " << params.no_storer_threads << ")\n";
+	std::cerr << "   --max-memory <int>            - limit (in MB) of memory used by data waiting between stages; 0 - no limit (default: " << params.max_memory << ")\n";
 	std::cerr << "   --out-prefix <string>         - prefix of output file names (default: " << params.out_prefix << ")\n";
 	std::cerr << "   --out-suffix <string>         - suffix of output file names (default: " << params.out_suffix << ")\n";
 	std::cerr << "   --part-digits <int>           - no. of digits in part_id (default: " << params.part_digits << ")\n";
-	std::cerr << "   --gzipped-output              - gzip ouptut files (default: false)\n";
+	std::cerr << "   --gzipped-output              - gzip ouptut files (same as --output-format gzip) (default: false)\n";
+	std::cerr << "   --output-format <string>      - format of output files: plain, gzip, bgzf (with .gzi index), zstd (default: plain)\n";
 	std::cerr << "   --gzip-level <int>            - compression level for output gzips (default: " << params.gzip_level << ")\n";
+	std::cerr << "   --gzip-engine <string>        - gzip compression engine: auto, libdeflate, isa-l, zlib-ng; auto uses isa-l for levels 1-3 if available (default: auto)\n";
+	std::cerr << "   --inflate-engine <string>     - gzip decompression engine for input: auto, isa-l, zlib-ng; auto picks the faster one on a sample of input (default: auto)\n";
+	std::cerr << "   --adaptive-gzip               - adapt gzip/bgzf compression level of each part to the load of packers and storer (default: false)\n";
+	std::cerr << "   --gzip-min-level <int>        - min. compression level in adaptive mode (default: " << params.gzip_min_level << ")\n";
+	std::cerr << "   --gzip-max-level <int>        - max. compression level in adaptive mode (default: " << params.gzip_max_level << ")\n";
+	std::cerr << "   --gzip-block-size <int>       - size (in MB) of blocks compressed in parallel as separate gzip members; 0 - whole parts (default: " << (params.gzip_block_size >> 20) << ")\n";
+	std::cerr << "   --zstd-level <int>            - compression level for zstd output (default: " << params.zstd_level << ")\n";
+	std::cerr << "   --zstd-workers <int>          - no. of zstd worker threads per packing thread (default: " << params.zstd_workers << ")\n";
+	std::cerr << "   --zstd-seekable               - produce zstd seekable format (frames of --gzip-block-size MB) (default: false)\n";
+	std::cerr << "   --write-fai                   - write .fai index next to each output file (plain or bgzf output only) (default: false)\n";
+	std::cerr << "   --unordered                   - do not preserve the order of records between parts; parts are numbered in order of completion (default: false)\n";
+	std::cerr << "   --manifest <string>           - name of file listing ranges of input records stored in each part (optional)\n";
+	std::cerr << "   --profile <string>            - name of JSON file with per-stage timings, queue statistics and the limiting stage (optional)\n";
+	std::cerr << "   --trace <string>              - name of file with timeline of processing of parts (Chrome trace-event JSON, for chrome://tracing or Perfetto) (optional)\n";
+	std::cerr << "   --progress <float>            - interval (in seconds) of reporting progress, throughput and ETA to stderr; 0 - no reporting (default: " << params.progress_interval << ")\n";
+	std::cerr << "   --progress-format <string>    - format of progress reports: text, json (one object per line) (default: text)\n";
 	std::cerr << "   --verbosity <int>             - verbosity level (default: " << params.verbosity << ")\n";
 //	std::cerr << "   --remove-empty-lines          - remove empty lines\n";
 	std::cerr << "   --remove-duplicates           - remove duplicated sequences (same SHA256 checksum) (default: false)\n";
@@ -223,126 +550,41 @@ void usage_mrds()
 	std::cerr << "Example: mfasta-tool mrds -n 1000 -i bacteria.fna\n";
 }
 
-// **************************************************
-bool process_mrds()
+// *****************************************************************************************
+void usage_extract()
 {
-	uint32_t n_hashing_threads = 1;
-	uint32_t n_packing_threads = 1;
-	uint32_t n_min_threads = params.remove_duplicates ? 6 : 4;
-
-	uint32_t n_threads = std::max<uint32_t>(n_min_threads, params.no_threads);
-	atomic<bool> is_ok = true;
-
-
-	if (params.remove_duplicates && params.gzipped_output)
-	{
-		uint32_t n = n_threads - 4;
-		
-		if (params.gzip_level <= 4)
-		{
-			n_hashing_threads = std::max<uint32_t>(1, n / 2);
-			n_packing_threads = std::max<uint32_t>(1, n - n_hashing_threads);
-		}
-		else if (params.gzip_level <= 6)
-		{
-			n_hashing_threads = std::max<uint32_t>(1, n / 3);
-			n_packing_threads = std::max<uint32_t>(1, n - n_hashing_threads);
-		}
-		else
-		{
-			n_hashing_threads = std::max<uint32_t>(1, n / 4);
-			n_packing_threads = std::max<uint32_t>(1, n - n_hashing_threads);
-		}
-	}
-	else if (params.remove_duplicates)
-	{
-		n_hashing_threads = n_min_threads - 5;
-	}
-	else if (params.gzipped_output)
-	{
-		n_packing_threads = n_min_threads - 3;
-	}
-
-	parallel_priority_queue<input_part_t> q_input_parts(params.input_queue_max_size, 1);
-	parallel_priority_queue<input_part_t> q_hashed_parts(params.input_queue_max_size, n_hashing_threads);
-	parallel_priority_queue<input_part_t> q_filtered_parts(params.input_queue_max_size, 1);
-	parallel_priority_queue<input_part_t> q_partitioned_parts(params.input_queue_max_size, 1);
-	parallel_priority_queue<packed_part_t> q_packed_parts(params.input_queue_max_size, n_packing_threads);
-
-	size_t no_unique = 0, no_duplicated = 0, no_removed = 0, no_stored = 0;
-
-	thread t_data_source([&is_ok, &q_input_parts] {
-		CDataSource data_source(params.in_names, params.in_prefixes, q_input_parts, params.remove_empty_lines, params.data_source_input_parts_size, params.soft_limit_size_in_part, params.verbosity);
-		if(!data_source.run())
-			is_ok = false;
-		});
-
-	vector<thread> vt_sha256_hashers;
-	if (params.remove_duplicates)
-		for (int i = 0; i < n_hashing_threads; ++i)
-			vt_sha256_hashers.emplace_back([&is_ok, &q_input_parts, &q_hashed_parts] {
-			CSHA256Hasher part_hasher(q_input_parts, q_hashed_parts, params.rev_comp_as_equivalent);
-			if(!part_hasher.run())
-				is_ok = false;
-				});
-
-	thread t_sha256_filter([&is_ok, &q_hashed_parts, &q_filtered_parts, &no_unique, &no_duplicated, &no_removed] {
-		if (params.remove_duplicates)
-		{
-			CSHA256Filter sha256_filter(params.rev_comp_as_equivalent, params.mark_duplicates_orientation, q_hashed_parts, q_filtered_parts, params.out_duplicates, params.data_source_input_parts_size);
-			if(!sha256_filter.run())
-				is_ok = false;
-			sha256_filter.get_stats(no_unique, no_duplicated, no_removed);
-		}
-		});
-
-	thread t_data_partitioner([&is_ok, &q_input_parts, &q_filtered_parts, &q_partitioned_parts] {
-		CDataPartitioner data_partitioner(params.remove_duplicates ? q_filtered_parts : q_input_parts, q_partitioned_parts, params.n);
-		if(!data_partitioner.run())
-			is_ok = false;
-	});
-
-	vector<thread> vt_data_packers;
-	for (int i = 0; i < n_packing_threads; ++i)
-		vt_data_packers.emplace_back([&is_ok, &q_partitioned_parts, &q_packed_parts] {
-		CPartPacker part_packer(q_partitioned_parts, q_packed_parts, params.gzipped_output, params.gzip_level);
-		if(!part_packer.run())
-			is_ok = false;
-			});
-
-	thread t_data_storer([&is_ok, &q_packed_parts, &no_stored] {
-		CDataStorer data_storer(q_packed_parts, params.n, params.out_name, params.out_prefix, params.out_suffix, params.part_digits, params.verbosity);
-		if(!data_storer.run())
-			is_ok = false;
-		data_storer.get_stats(no_stored);
-		});
-
-	t_data_source.join();
-	t_sha256_filter.join();
-	t_data_partitioner.join();
-	for (auto& t : vt_sha256_hashers)
-		t.join();
-	for (auto& t : vt_data_packers)
-		t.join();
-	t_data_storer.join();
-
-	if (params.verbosity > 0)
-	{
-		std::cerr << "*** Stats" << endl;
-		std::cerr << "No. input sequences: " << (params.remove_duplicates ? (no_unique + no_duplicated + no_removed) : no_stored) << endl;
-		if (params.remove_duplicates)
-		{
-			std::cerr << "   unique          : " << no_unique << endl;
-			std::cerr << "   duplicated      : " << no_duplicated << endl;
-			std::cerr << "   removed         : " << no_removed << endl;
-			std::cerr << "   preserved       : " << no_stored << endl;
-		}
-
-		if (params.out_name.empty())
-			std::cerr << "No. parts          : " << (no_stored + params.n - 1) / params.n << endl;
-	}
+	std::cerr << UTIL_VER << endl;
+	std::cerr << "Extract records of multi-FASTA files by ids\n";
+	std::cerr << "Usage:\n";
+	std::cerr << "mfasta-tool extract --ids <file> [options]\n";
+	std::cerr << "Options:\n";
+	std::cerr << "   --ids <string>                - file with ids, one per line; ids are compared up to the first space or tab (as in headers)\n";
+	std::cerr << "   --stop-early                  - stop reading input when all ids are found (default: false)\n";
+	std::cerr << "   -o | --out-name <string>      - output name when no splitting is made\n";
+	std::cerr << "   -n | --part-size <int>        - no. of sequences in a single output file; 0 - no splitting (default: " << params.n << ")\n";
+	std::cerr << "   -i | --in-names <string>      - comma-separated list of input file names\n";
+	std::cerr << "   --in-prefixes <string>        - comma-separated list of prefixes for ids of extracted records (optional)\n";
+	std::cerr << "   -t | --no-threads <int>       - no. of threads; 0 - no. of available cores (respecting cgroup CPU quota) (default: " << params.no_threads << ")\n";
+	std::cerr << "   --verbosity <int>             - verbosity level; 2 - list ids not found (default: " << params.verbosity << ")\n";
+	std::cerr << "Output, compression and monitoring options of mrds mode (except --remove-duplicates, --fused, --dynamic-scheduling) are also accepted.\n";
+	std::cerr << "Example: mfasta-tool extract --ids accessions.txt -i nt.fna.gz -o selected.fna.gz --output-format gzip --stop-early\n";
+}
 
-	return is_ok;
+// *****************************************************************************************
+void usage_stats()
+{
+	std::cerr << UTIL_VER << endl;
+	std::cerr << "Statistics of multi-FASTA files\n";
+	std::cerr << "Usage:\n";
+	std::cerr << "mfasta-tool stats [options]\n";
+	std::cerr << "Options:\n";
+	std::cerr << "   -i | --in-names <string>      - comma-separated list of input file names\n";
+	std::cerr << "   -o | --out-name <string>      - output file name (default: stdout)\n";
+	std::cerr << "   --format <string>             - output format: tsv (one row per input file and a total row), json (default: tsv)\n";
+	std::cerr << "   -t | --no-threads <int>       - no. of threads; 0 - no. of available cores (respecting cgroup CPU quota) (default: " << params.no_threads << ")\n";
+	std::cerr << "   --inflate-engine <string>     - gzip decompression engine for input: auto, isa-l, zlib-ng; auto picks the faster one on a sample of input (default: auto)\n";
+	std::cerr << "   --verbosity <int>             - verbosity level (default: " << params.verbosity << ")\n";
+	std::cerr << "Example: mfasta-tool stats -i bacteria.fna,viruses.fna.gz --format json\n";
 }
 
 // *****************************************************************************************
@@ -363,12 +605,31 @@ int main(int argc, char** argv)
 			return 1;
 		}
 		break;
+	case CParams::working_mode_t::extract:
+		if (!parse_args_mrds(argc, argv))
+		{
+			usage_extract();
+			return 1;
+		}
+		break;
+	case CParams::working_mode_t::stats:
+		if (!parse_args_stats(argc, argv))
+		{
+			usage_stats();
+			return 1;
+		}
+		break;
 	}
 
 	switch (params.working_mode)
 	{
 	case CParams::working_mode_t::mrds:
-		if (!process_mrds())
+	case CParams::working_mode_t::extract:
+		if (!process_mrds(params))
+			return 1;
+		break;
+	case CParams::working_mode_t::stats:
+		if (!process_stats(params))
 			return 1;
 		break;
 	case CParams::working_mode_t::info:
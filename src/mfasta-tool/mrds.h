@@ -0,0 +1,513 @@
+#pragma once
+
+#include <iostream>
+#include <thread>
+#include <atomic>
+#include <memory>
+
+#include "params.h"
+#include "data_source.h"
+#include "data_storer.h"
+#include "data_partitioner.h"
+#include "sha256_filter.h"
+#include "id_filter.h"
+#include "part_packer.h"
+#include "dynamic_scheduler.h"
+#include "fused_worker.h"
+#include "profiler.h"
+#include "trace.h"
+#include "progress.h"
+#include "system_info.h"
+#include "cpu_topology.h"
+#include "error_state.h"
+#include "memory_stats.h"
+
+using namespace std;
+
+// Threads of the pipeline for the requested no. of threads. Stages other than hashing and packing have single threads
+// (the storer can have more), so the requested no. is raised to the minimum of the static mode.
+struct mrds_threads_t
+{
+	uint32_t hashing = 1;
+	uint32_t packing = 1;
+	uint32_t pool_workers = 1;		// dynamic and fused modes
+
+	// Threads that do work (the filter thread is idle without duplicates removal or extraction)
+	uint32_t total(const CParams& params) const
+	{
+		bool filtering = params.remove_duplicates || params.working_mode == CParams::working_mode_t::extract;
+		uint32_t r = 1 + params.no_storer_threads;			// source, storers
+
+		// Filter and partitioner are run by the workers
+		if (params.fused)
+			return r + pool_workers;
+
+		r += 1 + (filtering ? 1 : 0);						// partitioner, filter
+
+		if (params.dynamic_scheduling)
+			return r + pool_workers;
+
+		return r + packing + (params.remove_duplicates ? hashing : 0);
+	}
+};
+
+inline mrds_threads_t mrds_thread_counts(const CParams& params)
+{
+	mrds_threads_t r;
+	uint32_t n_min_threads = params.remove_duplicates ? 6 : 4;
+
+	uint32_t n_requested_threads = params.no_threads ? params.no_threads : get_available_cores();
+	uint32_t n_threads = std::max<uint32_t>(n_min_threads, n_requested_threads);
+
+	// Hashing and packing are made by a shared pool of workers (other stages have own threads, mostly waiting)
+	r.pool_workers = std::max<uint32_t>(1, n_requested_threads > 2 ? n_requested_threads - 2 : 1);
+
+	if (params.dynamic_scheduling || params.fused)
+	{
+		r.hashing = r.pool_workers;
+		r.packing = r.pool_workers;
+	}
+	else if (params.remove_duplicates && params.compressed_output())
+	{
+		uint32_t n = n_threads - 4;
+
+		if (params.gzip_level <= 4)
+		{
+			r.hashing = std::max<uint32_t>(1, n / 2);
+			r.packing = std::max<uint32_t>(1, n - r.hashing);
+		}
+		else if (params.gzip_level <= 6)
+		{
+			r.hashing = std::max<uint32_t>(1, n / 3);
+			r.packing = std::max<uint32_t>(1, n - r.hashing);
+		}
+		else
+		{
+			r.hashing = std::max<uint32_t>(1, n / 4);
+			r.packing = std::max<uint32_t>(1, n - r.hashing);
+		}
+	}
+	else if (params.remove_duplicates)
+	{
+		r.hashing = n_threads - 5;
+	}
+	else if (params.compressed_output())
+	{
+		r.packing = n_threads - 3;
+	}
+
+	return r;
+}
+
+// **************************************************
+// Splits (and optionally deduplicates) input files; returns false on error.
+// In extract mode the filter keeps only records with ids from the given list (there is no deduplication).
+inline bool process_mrds(const CParams& params)
+{
+	bool extract = params.working_mode == CParams::working_mode_t::extract;
+
+	mrds_threads_t thread_counts = mrds_thread_counts(params);
+	uint32_t n_hashing_threads = thread_counts.hashing;
+	uint32_t n_packing_threads = thread_counts.packing;
+	uint32_t n_pool_workers = thread_counts.pool_workers;
+	atomic<bool> is_ok = true;
+
+	CPipelineProfiler profiler(!params.profile.empty());
+	CTracer tracer(!params.trace.empty());
+
+	unique_ptr<CProgress> progress;
+	if (params.progress_interval > 0)
+		progress = make_unique<CProgress>(params.in_names, params.progress_interval, params.progress_json);
+
+	parallel_priority_queue<input_part_t> q_input_parts(params.input_queue_max_size, 1, "input", profiler.queue_observer());
+	parallel_priority_queue<input_part_t> q_hashed_parts(params.input_queue_max_size, n_hashing_threads, "hashed", profiler.queue_observer());
+	parallel_priority_queue<input_part_t> q_filtered_parts(params.input_queue_max_size, 1, "filtered", profiler.queue_observer());
+	parallel_priority_queue<input_part_t> q_partitioned_parts(params.input_queue_max_size, 1, "partitioned", profiler.queue_observer());
+	parallel_priority_queue<packed_part_t> q_packed_parts(params.input_queue_max_size, n_packing_threads, "packed", profiler.queue_observer());
+
+	if (params.unordered)
+	{
+		q_input_parts.set_unordered(true);
+		q_hashed_parts.set_unordered(true);
+		q_filtered_parts.set_unordered(true);
+		q_partitioned_parts.set_unordered(true);
+		q_packed_parts.set_unordered(true);
+	}
+
+	// Data source stops reading when total footprint of queued parts reaches the limit, single queue can take half of it
+	unique_ptr<CMemoryGovernor> memory_governor;
+	auto input_footprint = [](const input_part_t& part) { return footprint(part); };
+	auto packed_footprint = [](const packed_part_t& part) { return footprint(part); };
+
+	if (params.max_memory)
+	{
+		memory_governor = make_unique<CMemoryGovernor>(params.max_memory << 20);
+
+		size_t queue_max_bytes = memory_governor->get_max_bytes() / 2;
+
+		q_input_parts.set_max_bytes(queue_max_bytes, input_footprint, memory_governor->get_counter());
+		q_hashed_parts.set_max_bytes(queue_max_bytes, input_footprint, memory_governor->get_counter());
+		q_filtered_parts.set_max_bytes(queue_max_bytes, input_footprint, memory_governor->get_counter());
+		q_partitioned_parts.set_max_bytes(queue_max_bytes, input_footprint, memory_governor->get_counter());
+		q_packed_parts.set_max_bytes(queue_max_bytes, packed_footprint, memory_governor->get_counter());
+	}
+	else if (profiler.is_enabled() || params.verbosity > 0)
+	{
+		// No limit, footprints are only reported to the profiler and in stats
+		q_input_parts.set_max_bytes(0, input_footprint);
+		q_hashed_parts.set_max_bytes(0, input_footprint);
+		q_filtered_parts.set_max_bytes(0, input_footprint);
+		q_partitioned_parts.set_max_bytes(0, input_footprint);
+		q_packed_parts.set_max_bytes(0, packed_footprint);
+	}
+
+	// Stages are described by their queues; the shared pools are profiled as a single stage
+	profiler.add_stage("source", "", "input", 1, false);
+	if (params.fused)
+		profiler.add_stage("workers", "input", "packed", n_pool_workers, true);
+	else
+	{
+		if (params.dynamic_scheduling)
+			profiler.add_stage("workers", "", "packed", n_pool_workers, true);
+		else
+		{
+			if (params.remove_duplicates)
+				profiler.add_stage("hashing", "input", "hashed", n_hashing_threads, true);
+			profiler.add_stage("packing", "partitioned", "packed", n_packing_threads, true);
+		}
+
+		if (params.remove_duplicates)
+			profiler.add_stage("filter", "hashed", "filtered", 1, false);
+		else if (extract)
+			profiler.add_stage("filter", "input", "filtered", 1, false);
+		profiler.add_stage("partitioner", params.remove_duplicates || extract ? "filtered" : "input", "partitioned", 1, false);
+	}
+	profiler.add_stage("storer", "packed", "", 1, false);
+
+	CMemoryStats memory_stats;
+
+	// Ids are loaded before the processing starts, so a wrong file is reported at once
+	CIdSet id_set;
+	atomic<bool> stop_reading = false;
+	size_t no_scanned = 0, no_extracted = 0;
+
+	if (extract)
+	{
+		if (!id_set.load(params.extract_ids))
+			return false;
+
+		memory_stats.dict_bytes.set(id_set.footprint());
+		memory_stats.dict_entries.set(id_set.size());
+	}
+
+	CRecyclePool<input_part_t> input_part_pool(params.recycle_pool_size, &memory_stats.recycled_parts);
+	CRecyclePool<packed_part_t> packed_part_pool(params.recycle_pool_size, &memory_stats.recycled_parts);
+
+	size_t no_unique = 0, no_duplicated = 0, no_removed = 0, no_stored = 0, no_parts = 0;
+	uint64_t no_lines = 0, no_reused_lines = 0;
+	string inflate_engine;
+
+	unique_ptr<CAdaptiveCompressionLevel> adaptive_level;
+	if (params.adaptive_gzip && (params.output_format == CParams::output_format_t::gzip || params.output_format == CParams::output_format_t::bgzf))
+		adaptive_level = make_unique<CAdaptiveCompressionLevel>(params.gzip_min_level, params.gzip_max_level, params.gzip_level, n_packing_threads);
+
+	// In fused mode the filter and the partitioner are shared by the workers and used only in the ordered section
+	unique_ptr<CSHA256Filter> fused_filter;
+	unique_ptr<CDataPartitioner> fused_partitioner;
+	unique_ptr<CFusedSection> fused_section;
+	if (params.fused)
+	{
+		if (params.remove_duplicates)
+		{
+			fused_filter = make_unique<CSHA256Filter>(params.rev_comp_as_equivalent, params.mark_duplicates_orientation, q_hashed_parts, q_filtered_parts, params.out_duplicates, params.data_source_input_parts_size,
+				progress.get(), &memory_stats);
+			if (!fused_filter->open_log())
+			{
+				std::cerr << "Error: " << fused_filter->get_error() << endl;
+				return false;
+			}
+		}
+
+		fused_partitioner = make_unique<CDataPartitioner>(q_input_parts, q_partitioned_parts, params.n,
+			params.compressed_output() && !params.unordered ? params.gzip_block_size : 0);
+		fused_section = make_unique<CFusedSection>(fused_filter.get(), *fused_partitioner, !params.unordered, profiler.idle_counter("workers"));
+	}
+
+	// The first error cancels all queues, so all stages stop
+	CErrorState error_state;
+	error_state.add_cancel_callback([&q_input_parts, &q_hashed_parts, &q_filtered_parts, &q_partitioned_parts, &q_packed_parts, &fused_section, &memory_governor] {
+		q_input_parts.cancel();
+		q_hashed_parts.cancel();
+		q_filtered_parts.cancel();
+		q_partitioned_parts.cancel();
+		q_packed_parts.cancel();
+		if (fused_section)
+			fused_section->cancel();
+		if (memory_governor)
+			memory_governor->cancel();
+		});
+
+	auto fail = [&is_ok, &error_state](const string& stage, const string& message = "") {
+		is_ok = false;
+		error_state.report(stage, message);
+		};
+
+	unique_ptr<CCpuTopology> cpu_topology;
+	if (params.pin_threads || params.verbosity >= 2)
+		cpu_topology = make_unique<CCpuTopology>();
+
+	// CPUs are assigned in the order of thread creation; each thread pins itself before it starts its work
+	auto cpu_for = [&params, &cpu_topology](const string& role, bool pinned = true) {
+		return params.pin_threads && cpu_topology && pinned ? cpu_topology->assign(role) : -1;
+		};
+
+	// Threads created by zstd (workers) or by the storer inherit the mask of their parent, so such parents are not pinned
+	bool pin_packers = params.zstd_workers == 0 || params.output_format != CParams::output_format_t::zstd;
+
+	profiler.start();
+	if (progress)
+		progress->start();
+
+	thread t_data_source([cpu = cpu_for("source"), &params, &fail, &profiler, &tracer, &progress, &q_input_parts, &memory_governor, &memory_stats, &input_part_pool, &no_lines, &no_reused_lines, &inflate_engine, &stop_reading] {
+		CCpuTopology::pin_current_thread(cpu);
+		CPipelineProfiler::CThreadTimer thread_timer(profiler.stage("source"));
+		CTraceThread trace_thread(&tracer, "source");
+		CDataSource data_source(params.in_names, params.in_prefixes, q_input_parts, params.remove_empty_lines, params.data_source_input_parts_size, params.soft_limit_size_in_part, params.verbosity,
+			memory_governor.get(), &input_part_pool, progress.get(), &memory_stats, params.inflate_engine, &stop_reading);
+		if(!data_source.run())
+			fail("data source", data_source.get_error());
+		data_source.get_stats(no_lines, no_reused_lines);
+		inflate_engine = data_source.get_inflate_engine();
+		});
+
+	vector<thread> vt_sha256_hashers;
+	if (params.remove_duplicates && !params.dynamic_scheduling && !params.fused)
+		for (int i = 0; i < n_hashing_threads; ++i)
+		{
+			vt_sha256_hashers.emplace_back([cpu = cpu_for("hasher"), &params, &fail, &profiler, &tracer, i, &q_input_parts, &q_hashed_parts] {
+			CCpuTopology::pin_current_thread(cpu);
+			CPipelineProfiler::CThreadTimer thread_timer(profiler.stage("hashing"));
+			CTraceThread trace_thread(&tracer, "hasher " + to_string(i));
+			CSHA256Hasher part_hasher(q_input_parts, q_hashed_parts, params.rev_comp_as_equivalent);
+			if(!part_hasher.run())
+				fail("hashing");
+				});
+		}
+
+	thread t_sha256_filter([cpu = cpu_for("filter", (params.remove_duplicates || extract) && !params.fused), &params, extract, &fail, &profiler, &tracer, &progress, &memory_stats, &q_input_parts, &q_hashed_parts, &q_filtered_parts, &no_unique, &no_duplicated, &no_removed,
+		&id_set, &stop_reading, &no_scanned, &no_extracted] {
+		CCpuTopology::pin_current_thread(cpu);
+		CPipelineProfiler::CThreadTimer thread_timer(profiler.stage("filter"));
+		CTraceThread trace_thread((params.remove_duplicates || extract) && !params.fused ? &tracer : nullptr, "filter");
+		if (extract)
+		{
+			CIdFilter id_filter(q_input_parts, q_filtered_parts, id_set, params.stop_early, &stop_reading, progress.get());
+			if (!id_filter.run())
+				fail("id filter");
+			id_filter.get_stats(no_scanned, no_extracted);
+		}
+		else if (params.remove_duplicates && !params.fused)
+		{
+			CSHA256Filter sha256_filter(params.rev_comp_as_equivalent, params.mark_duplicates_orientation, q_hashed_parts, q_filtered_parts, params.out_duplicates, params.data_source_input_parts_size,
+				progress.get(), &memory_stats);
+			if(!sha256_filter.run())
+				fail("duplicates filter", sha256_filter.get_error());
+			sha256_filter.get_stats(no_unique, no_duplicated, no_removed);
+		}
+		});
+
+	thread t_data_partitioner([cpu = cpu_for("partitioner", !params.fused), &params, extract, &fail, &profiler, &tracer, &q_input_parts, &q_filtered_parts, &q_partitioned_parts, &input_part_pool] {
+		CCpuTopology::pin_current_thread(cpu);
+		CPipelineProfiler::CThreadTimer thread_timer(profiler.stage("partitioner"));
+		CTraceThread trace_thread(params.fused ? nullptr : &tracer, "partitioner");
+		if (!params.fused)
+		{
+			CDataPartitioner data_partitioner(params.remove_duplicates || extract ? q_filtered_parts : q_input_parts, q_partitioned_parts, params.n,
+				// Fragments of a record must be stored in order, so records are not cut in unordered mode
+				params.compressed_output() && !params.unordered ? params.gzip_block_size : 0, &input_part_pool);
+			if(!data_partitioner.run())
+				fail("partitioner");
+		}
+	});
+
+	auto make_part_packer = [&params, &adaptive_level, &input_part_pool, &packed_part_pool, &memory_stats, &q_packed_parts](parallel_priority_queue<input_part_t>& q_in) {
+		return make_unique<CPartPacker>(q_in, q_packed_parts, params.output_format, params.gzip_level, params.zstd_level, params.zstd_workers,
+			params.zstd_seekable ? std::max<size_t>(params.gzip_block_size, 1 << 20) : 0, params.write_fai,
+			adaptive_level.get(), params.gzip_engine, !params.manifest.empty(), &input_part_pool, &packed_part_pool, &memory_stats);
+		};
+
+	atomic<uint64_t> no_hash_tasks = 0, no_pack_tasks = 0;
+	vector<thread> vt_pool_workers;
+	if (params.dynamic_scheduling)
+		for (uint32_t i = 0; i < n_pool_workers; ++i)
+		{
+			vt_pool_workers.emplace_back([cpu = cpu_for("worker", pin_packers), &params, &fail, &profiler, &tracer, i, &make_part_packer, &q_input_parts, &q_hashed_parts, &q_partitioned_parts, &no_hash_tasks, &no_pack_tasks] {
+			CCpuTopology::pin_current_thread(cpu);
+			CPipelineProfiler::CThreadTimer thread_timer(profiler.stage("workers"));
+			CTraceThread trace_thread(&tracer, "worker " + to_string(i));
+			unique_ptr<CSHA256Hasher> part_hasher;
+			if (params.remove_duplicates)
+				part_hasher = make_unique<CSHA256Hasher>(q_input_parts, q_hashed_parts, params.rev_comp_as_equivalent);
+			auto part_packer = make_part_packer(q_partitioned_parts);
+			CDynamicWorker worker(params.remove_duplicates ? &q_input_parts : nullptr, q_partitioned_parts, part_hasher.get(), *part_packer, no_hash_tasks, no_pack_tasks,
+				profiler.idle_counter("workers"));
+			if (!worker.run())
+				fail("worker pool", part_packer->get_error());
+				});
+		}
+
+	vector<thread> vt_fused_workers;
+	if (params.fused)
+		for (uint32_t i = 0; i < n_pool_workers; ++i)
+		{
+			vt_fused_workers.emplace_back([cpu = cpu_for("worker", pin_packers), &params, &fail, &profiler, &tracer, i, &make_part_packer, &q_input_parts, &q_hashed_parts, &fused_section, &input_part_pool] {
+			CCpuTopology::pin_current_thread(cpu);
+			CPipelineProfiler::CThreadTimer thread_timer(profiler.stage("workers"));
+			CTraceThread trace_thread(&tracer, "worker " + to_string(i));
+			unique_ptr<CSHA256Hasher> part_hasher;
+			if (params.remove_duplicates)
+				part_hasher = make_unique<CSHA256Hasher>(q_input_parts, q_hashed_parts, params.rev_comp_as_equivalent);
+			// Backlog of input parts drives the adaptive compression level, as there is no queue of partitioned parts
+			auto part_packer = make_part_packer(q_input_parts);
+			CFusedWorker worker(q_input_parts, part_hasher.get(), *fused_section, *part_packer, &input_part_pool);
+			if (!worker.run())
+				fail("fused worker", part_packer->get_error());
+				});
+		}
+
+	vector<thread> vt_data_packers;
+	for (int i = 0; i < n_packing_threads && !params.dynamic_scheduling && !params.fused; ++i)
+	{
+		vt_data_packers.emplace_back([cpu = cpu_for("packer", pin_packers), &params, &fail, &profiler, &tracer, i, &make_part_packer, &q_partitioned_parts] {
+		CCpuTopology::pin_current_thread(cpu);
+		CPipelineProfiler::CThreadTimer thread_timer(profiler.stage("packing"));
+		CTraceThread trace_thread(&tracer, "packer " + to_string(i));
+		auto part_packer = make_part_packer(q_partitioned_parts);
+		if(!part_packer->run())
+			fail("packing", part_packer->get_error());
+			});
+	}
+
+	thread t_data_storer([cpu = cpu_for("storer", params.no_storer_threads == 1), &params, &fail, &profiler, &tracer, &progress, &q_packed_parts, &no_stored, &no_parts, &input_part_pool, &packed_part_pool] {
+		CCpuTopology::pin_current_thread(cpu);
+		CPipelineProfiler::CThreadTimer thread_timer(profiler.stage("storer"));
+		CTraceThread trace_thread(&tracer, "storer");
+		CDataStorer data_storer(q_packed_parts, params.n, params.out_name, params.out_prefix, params.out_suffix, params.part_digits, params.verbosity, params.no_storer_threads,
+			params.output_format, params.zstd_seekable, params.write_fai, params.manifest, params.in_names,
+			&input_part_pool, &packed_part_pool, progress.get());
+		if(!data_storer.run())
+			fail("storer", data_storer.get_error());
+		data_storer.get_stats(no_stored, no_parts);
+		});
+
+	if (params.verbosity >= 2 && cpu_topology)
+		cpu_topology->print(std::cerr);
+
+	t_data_source.join();
+	t_sha256_filter.join();
+	t_data_partitioner.join();
+	for (auto& t : vt_sha256_hashers)
+		t.join();
+	for (auto& t : vt_data_packers)
+		t.join();
+	for (auto& t : vt_pool_workers)
+		t.join();
+	for (auto& t : vt_fused_workers)
+		t.join();
+	t_data_storer.join();
+
+	profiler.stop();
+	if (progress)
+		progress->stop(is_ok);
+
+	// Trace is written also after a failure, as it can help to find the reason
+	if (tracer.is_enabled() && !tracer.write_json(params.trace))
+		return false;
+
+	if (!is_ok)
+	{
+		std::cerr << "Error: " << error_state.get_first_error() << endl;
+		return false;
+	}
+
+	if (fused_filter)
+	{
+		fused_filter->write_log();
+		fused_filter->get_stats(no_unique, no_duplicated, no_removed);
+	}
+
+	memory_stats.add_queue_peak("input", q_input_parts.get_peak_bytes());
+	memory_stats.add_queue_peak("hashed", q_hashed_parts.get_peak_bytes());
+	memory_stats.add_queue_peak("filtered", q_filtered_parts.get_peak_bytes());
+	memory_stats.add_queue_peak("partitioned", q_partitioned_parts.get_peak_bytes());
+	memory_stats.add_queue_peak("packed", q_packed_parts.get_peak_bytes());
+
+	if (profiler.is_enabled() && !profiler.write_json(params.profile, &memory_stats))
+		return false;
+
+	if (params.verbosity > 0)
+	{
+		std::cerr << "*** Stats" << endl;
+		std::cerr << "No. input sequences: " << (params.remove_duplicates ? (no_unique + no_duplicated + no_removed) : extract ? no_scanned : no_stored) << endl;
+		if (params.remove_duplicates)
+		{
+			std::cerr << "   unique          : " << no_unique << endl;
+			std::cerr << "   duplicated      : " << no_duplicated << endl;
+			std::cerr << "   removed         : " << no_removed << endl;
+			std::cerr << "   preserved       : " << no_stored << endl;
+		}
+
+		if (extract)
+		{
+			std::cerr << "   extracted       : " << no_extracted << endl;
+			std::cerr << "Ids found          : " << id_set.get_no_found() << " of " << id_set.size() << endl;
+		}
+
+		if (params.out_name.empty())
+			std::cerr << "No. parts          : " << no_parts << endl;
+
+		if (params.dynamic_scheduling)
+			std::cerr << "Pool tasks         : " << n_pool_workers << " workers, hashing " << no_hash_tasks << ", packing " << no_pack_tasks << endl;
+
+		if (params.fused)
+			std::cerr << "Fused workers      : " << n_pool_workers << endl;
+
+		if (!inflate_engine.empty())
+			std::cerr << "Inflate engine     : " << inflate_engine << endl;
+
+		if (params.output_format == CParams::output_format_t::gzip)
+			std::cerr << "Gzip engine        : " << make_gzip_compressor(params.gzip_engine, params.gzip_level)->name() << endl;
+
+		if (adaptive_level)
+		{
+			std::cerr << "Compression levels :";
+			for (const auto& x : adaptive_level->get_stats())
+				std::cerr << " " << x.first << ":" << x.second;
+			std::cerr << endl;
+		}
+
+		std::cerr << "Pool hit rates     : input parts " << 100 * input_part_pool.hit_rate() << "%, packed parts " << 100 * packed_part_pool.hit_rate()
+			<< "%, lines " << (no_lines ? 100.0 * no_reused_lines / no_lines : 0.0) << "%" << endl;
+
+		if (memory_governor)
+		{
+			size_t peak_in_queues;
+			double throttled_time;
+			memory_governor->get_stats(peak_in_queues, throttled_time);
+			std::cerr << "Peak queued memory : " << (peak_in_queues >> 20) << " MB" << endl;
+			std::cerr << "Input throttled    : " << throttled_time << " s" << endl;
+		}
+
+		memory_stats.print(std::cerr);
+	}
+
+	if (extract && !id_set.all_found())
+	{
+		std::cerr << "Warning: " << id_set.size() - id_set.get_no_found() << " of " << id_set.size() << " ids not found" << endl;
+		if (params.verbosity > 1)
+			for (const auto& id : id_set.get_missing())
+				std::cerr << "   " << id << endl;
+	}
+
+	return is_ok;
+}
@@ -8,7 +8,10 @@ using namespace std;
 
 struct CParams
 {
-	enum class working_mode_t { none, info, mrds };
+	enum class working_mode_t { none, info, mrds, stats, extract };
+	enum class output_format_t { plain, gzip, bgzf, zstd };
+	enum class gzip_engine_t { auto_select, libdeflate, isal, zlib_ng };
+	enum class inflate_engine_t { auto_select, isal, zlib_ng };
 
 	working_mode_t working_mode = working_mode_t::none;
 	vector<string> in_names;
@@ -16,12 +19,33 @@ struct CParams
 	string out_name;
 	string out_prefix = "part";
 	string out_suffix = "fna";
-	bool gzipped_output = false;
+	output_format_t output_format = output_format_t::plain;
 	int gzip_level = 4;
+	size_t gzip_block_size = 4 << 20;
+	bool adaptive_gzip = false;
+	int gzip_min_level = 1;
+	int gzip_max_level = 9;
+	gzip_engine_t gzip_engine = gzip_engine_t::auto_select;
+	inflate_engine_t inflate_engine = inflate_engine_t::auto_select;
+	int zstd_level = 3;
+	int zstd_workers = 0;
+	bool zstd_seekable = false;
+	bool write_fai = false;
+	bool unordered = false;
+	string manifest;
 	int64_t n = 0;
 	int part_digits = 5;
 	bool remove_empty_lines = true;
 	int no_threads = 4;
+	int no_storer_threads = 1;
+	bool dynamic_scheduling = false;
+	bool fused = false;
+	bool pin_threads = false;
+	size_t max_memory = 0;				// in MB, 0 - no limit
+	string profile;
+	string trace;
+	double progress_interval = 0;		// in seconds, 0 - no reporting
+	bool progress_json = false;
 	int verbosity = 0;
 
 	// Duplictes
@@ -30,8 +54,21 @@ struct CParams
 	string out_duplicates;
 	bool mark_duplicates_orientation = false;
 
+	// Extraction
+	string extract_ids;					// file with ids of records to extract
+	bool stop_early = false;
+
+	// Stats
+	bool stats_json = false;
+
 	// *** Internal params
 	const size_t data_source_input_parts_size = 32;
 	const size_t soft_limit_size_in_part = 1 << 20;
 	const size_t input_queue_max_size = 128;
+	const size_t recycle_pool_size = 16;
+
+	bool compressed_output() const
+	{
+		return output_format != output_format_t::plain;
+	}
 };
@@ -3,6 +3,15 @@
 #include "defs.h"
 #include "data_source.h"
 #include "utils.h"
+#include "params.h"
+#include "bgzf.h"
+#include "zstd_wrapper.h"
+#include "adaptive_level.h"
+#include "gzip_compressor.h"
+#include "recycle_pool.h"
+#include "trace.h"
+#include "memory_stats.h"
+#include "error_state.h"
 
 #include <refresh/compression/lib/gz_wrapper.h>
 #include <refresh/parallel_queues/lib/parallel-queues.h>
@@ -13,89 +22,347 @@ class CPartPacker
 {
 	parallel_priority_queue<input_part_t>& q_partitioned_parts;
 	parallel_priority_queue<packed_part_t>& q_packed_parts;
-	bool gzipped_output;
+	CParams::output_format_t output_format;
 	int gzip_level;
 
 	packed_part_t packed_part;
 	memory_block_t buffer;
 
-	gz_in_memory gim;
+	size_t zstd_frame_size;
+	bool write_fai;
+	bool build_manifest;
+	CAdaptiveCompressionLevel* adaptive_level;
+	CRecyclePool<input_part_t>* input_part_pool;
+	CRecyclePool<packed_part_t>* packed_part_pool;
+	CMemoryStats* memory_stats;
+	size_t accounted_bytes = 0;
+	CStageError error;
+	bool failed = false;
 
-	void do_pack(input_part_t& input_part)
+	unique_ptr<CGzipCompressor> gzip_compressor;
+	CBGZFCompressor bgzf;
+#ifdef REFRESH_USE_ZSTD
+	CZstdCompressor zstd;
+#endif
+
+	void add_fai_entry(const input_item_t& item, size_t offset, fai_entry_t& entry)
 	{
-		size_t raw_size = 0;
+		entry.offset = offset;
+
+		for (const auto& line : item.lines)
+		{
+			if (line == "\n")
+				continue;
+
+			if (entry.line_bases == 0)
+			{
+				entry.line_bases = (uint32_t) line.size();
+				entry.line_width = (uint32_t) line.size() + 1;
+			}
+
+			entry.length += line.size();
+		}
+	}
+
+	// Passes consecutive pieces of the output (FASTA) data to append; returns total size of data
+	template<typename APPEND>
+	size_t serialize(const input_part_t& input_part, APPEND append)
+	{
+		static const char eol = '\n';
+		size_t pos = 0;
+
+		auto add = [&append, &pos](const char* ptr, size_t len) {
+			if (len)
+			{
+				append(ptr, len);
+				pos += len;
+			}
+			};
 
 		for (const auto& item : input_part)
 		{
-			raw_size += item.id.size() + 1;
-			raw_size += item.prefix.size();
+			if (item.first_fragment)
+			{
+				// The same as build_new_id(item.id, item.prefix), but without creating a new string
+				add(item.id.data(), 1);
+				add(item.prefix.data(), item.prefix.size());
+				add(item.id.data() + 1, item.id.size() - 1);
+				add(&eol, 1);
+
+				if (write_fai)
+					packed_part.fai_entries.emplace_back().name = item.prefix + strip_id(item.id).substr(1);
+			}
+			else if (write_fai)
+				packed_part.fai_entries.emplace_back().continuation = true;
+
+			if (write_fai)
+				add_fai_entry(item, pos, packed_part.fai_entries.back());
+
 			for (const auto& line : item.lines)
-				raw_size += line.size() + 1;
+			{
+				add(line.data(), line.size());
+				if(line.size() > 1 || (line.size() == 1 && line.front() != '\n'))
+					add(&eol, 1);
+			}
 		}
 
-		buffer.clear();
-		buffer.reserve(raw_size);
+		return pos;
+	}
+
+	void collect_record_ranges(const input_part_t& input_part)
+	{
+		auto& ranges = packed_part.record_ranges;
 
 		for (const auto& item : input_part)
 		{
-			string new_id = build_new_id(item.id, item.prefix);
+			if (!ranges.empty() && ranges.back().file_id == item.file_id && item.record_no <= ranges.back().last + 1 && item.record_no >= ranges.back().first)
+				ranges.back().last = std::max(ranges.back().last, item.record_no);
+			else
+				ranges.push_back(record_range_t{ item.file_id, item.record_no, item.record_no });
+		}
+	}
+
+	// Uncompressed output - long lines are not copied, only views to them are prepared for the storer.
+	// Short pieces (headers, lines of typical width, EOLs) are copied to memory_block, so consecutive ones make a single view
+	// and a writev call with IOV_MAX views stores more than a few tens of KB.
+	void do_pack_views(input_part_t& input_part)
+	{
+		static const size_t max_copied_len = 4096;
+
+		packed_part.views.clear();
 
-			buffer.insert(buffer.end(), new_id.begin(), new_id.end());
-			buffer.emplace_back('\n');
+		// Block is allocated at once, as views point into it (the size is an upper bound, as EOLs are counted for all lines)
+		size_t copied_size = 0;
 
+		auto add_copied = [&copied_size](size_t len) {
+			if (len < max_copied_len)
+				copied_size += len;
+			};
+
+		for (const auto& item : input_part)
+		{
+			if (item.first_fragment)
+			{
+				add_copied(item.prefix.size());
+				add_copied(item.id.size() - 1);
+				copied_size += 2;
+			}
 			for (const auto& line : item.lines)
 			{
-				buffer.insert(buffer.end(), line.begin(), line.end());
-				if(line.size() > 1 || (line.size() == 1 && line.front() != '\n'))
-					buffer.emplace_back('\n');
+				add_copied(line.size());
+				++copied_size;
 			}
 		}
 
-		if (gzipped_output)
+		packed_part.memory_block.clear();
+		packed_part.memory_block.reserve(copied_size);
+
+		auto& block = packed_part.memory_block;
+		bool last_in_block = false;
+
+		packed_part.raw_size = serialize(input_part, [this, &block, &last_in_block](const char* ptr, size_t len) {
+			if (len >= max_copied_len)
+			{
+				packed_part.views.emplace_back(ptr, len);
+				last_in_block = false;
+				return;
+			}
+
+			const char* dest = (const char*) block.data() + block.size();
+			block.insert(block.end(), ptr, ptr + len);
+
+			if (last_in_block)
+				packed_part.views.back() = string_view(packed_part.views.back().data(), packed_part.views.back().size() + len);
+			else
+				packed_part.views.emplace_back(dest, len);
+			last_in_block = true;
+			});
+
+		// Views point to the strings owned by the part, so it must be moved together with them
+		packed_part.source_part = move(input_part);
+	}
+
+	// Returns false if the part cannot be compressed
+	bool do_pack(input_part_t& input_part)
+	{
+		size_t no_items = 0;
+
+		for (const auto& item : input_part)
+			if (item.last_fragment)
+				++no_items;
+
+		packed_part.no_items = no_items;
+
+		if (build_manifest)
+			collect_record_ranges(input_part);
+
+		if (output_format == CParams::output_format_t::plain)
 		{
-			packed_part.memory_block.resize(raw_size + gim.get_overhead(raw_size));
-			auto packed_size = gim.compress(buffer.data(), buffer.size(), packed_part.memory_block.data(), packed_part.memory_block.size());
-			packed_part.memory_block.resize(packed_size);
+			do_pack_views(input_part);
+			return true;
 		}
-		else
-			packed_part.memory_block.swap(buffer);
 
-		packed_part.no_items = input_part.size();
+		size_t raw_size = 0;
 
-		input_part.clear();
+		for (const auto& item : input_part)
+		{
+			if (item.first_fragment)
+			{
+				raw_size += item.id.size() + 1;
+				raw_size += item.prefix.size();
+			}
+			for (const auto& line : item.lines)
+				raw_size += line.size() + 1;
+		}
+
+		buffer.clear();
+		buffer.reserve(raw_size);
+
+		// Compressors need contiguous input (libdeflate has no streaming interface)
+		packed_part.raw_size = serialize(input_part, [this](const char* ptr, size_t len) {
+			buffer.insert(buffer.end(), ptr, ptr + len);
+			});
+
+		int level = gzip_level;
+
+		if (adaptive_level)
+			level = adaptive_level->get_level(
+				(double) q_partitioned_parts.size() / q_partitioned_parts.get_max_size(),
+				(double) q_packed_parts.size() / q_packed_parts.get_max_size());
+
+		if (output_format == CParams::output_format_t::gzip)
+		{
+			packed_part.memory_block.resize(gzip_compressor->compress_bound(raw_size));
+			auto packed_size = gzip_compressor->compress(buffer.data(), buffer.size(), packed_part.memory_block.data(), packed_part.memory_block.size(), level);
+
+			if (packed_size == 0)
+			{
+				error.set("gzip compression failed (" + gzip_compressor->name() + ", level " + to_string(level) + ", " + to_string(raw_size) + " bytes)");
+				return false;
+			}
 
-		if (buffer.capacity() > 8 << 20)
+			packed_part.memory_block.resize(packed_size);
+		}
+		else if (output_format == CParams::output_format_t::bgzf)
+		{
+			bgzf.set_compression_level(level);
+			bgzf.compress(buffer.data(), buffer.size(), packed_part.memory_block, packed_part.blocks);
+		}
+#ifdef REFRESH_USE_ZSTD
+		else if (output_format == CParams::output_format_t::zstd)
 		{
-			buffer.clear();
-			buffer.shrink_to_fit();
+			if (!zstd.compress(buffer.data(), buffer.size(), packed_part.memory_block, packed_part.blocks, zstd_frame_size))
+			{
+				error.set("zstd compression failed: " + zstd.get_error());
+				return false;
+			}
 		}
+#endif
+
+		return true;
+	}
+
+	// Reports change of sizes of own buffers (the packed part is accounted by the queue after it is pushed)
+	void account_buffers()
+	{
+		if (!memory_stats)
+			return;
+
+		size_t bytes = buffer.capacity() + packed_part.memory_block.capacity();
+		memory_stats->packer_buffers.add((int64_t) bytes - (int64_t) accounted_bytes);
+		accounted_bytes = bytes;
 	}
 
 public:
 	CPartPacker(parallel_priority_queue<input_part_t>& q_partitioned_parts, parallel_priority_queue<packed_part_t>& q_packed_parts,
-		bool gzipped_output, int gzip_level) :
+		CParams::output_format_t output_format, int gzip_level, int zstd_level = 3, int zstd_workers = 0, size_t zstd_frame_size = 0, bool write_fai = false,
+		CAdaptiveCompressionLevel* adaptive_level = nullptr, CParams::gzip_engine_t gzip_engine = CParams::gzip_engine_t::auto_select,
+		bool build_manifest = false, CRecyclePool<input_part_t>* input_part_pool = nullptr, CRecyclePool<packed_part_t>* packed_part_pool = nullptr,
+		CMemoryStats* memory_stats = nullptr) :
 		q_partitioned_parts(q_partitioned_parts),
 		q_packed_parts(q_packed_parts),
-		gzipped_output(gzipped_output),
+		output_format(output_format),
 		gzip_level(gzip_level),
-		gim(gzip_level)
+		zstd_frame_size(zstd_frame_size),
+		write_fai(write_fai),
+		build_manifest(build_manifest),
+		adaptive_level(adaptive_level),
+		input_part_pool(input_part_pool),
+		packed_part_pool(packed_part_pool),
+		memory_stats(memory_stats),
+		gzip_compressor(make_gzip_compressor(gzip_engine, gzip_level)),
+		bgzf(gzip_level)
+#ifdef REFRESH_USE_ZSTD
+		, zstd(zstd_level, zstd_workers)
+#endif
 	{}
 
+	~CPartPacker()
+	{
+		if (memory_stats)
+			memory_stats->packer_buffers.add(-(int64_t) accounted_bytes);
+	}
+
+	// Packs a single part and passes it to the next stage; returns false if the pipeline was canceled or packing failed
+	bool process(input_part_t& input_part, uint64_t priority)
+	{
+		{
+			CTraceSpan span("pack", priority);
+			if (!do_pack(input_part))
+			{
+				failed = true;
+				return false;
+			}
+		}
+
+		account_buffers();
+
+		bool r;
+		{
+			CTraceSpan span("push", priority);
+			r = q_packed_parts.push_or_cancel(priority, move(packed_part));
+		}
+
+		// Compressed part is not needed anymore, so it goes back to the data source (together with its lines)
+		if (input_part_pool && !input_part.empty())
+			input_part_pool->put(move(input_part));
+		input_part.clear();
+
+		packed_part.clear();
+		if (packed_part_pool)
+			packed_part_pool->get(packed_part);
+
+		account_buffers();
+
+		return r;
+	}
+
+	void mark_completed()
+	{
+		q_packed_parts.mark_completed();
+	}
+
 	bool run()
 	{
 		input_part_t input_part;
 		uint64_t priority;
 
 		while (q_partitioned_parts.pop(input_part, priority))
-		{
-			do_pack(input_part);
+			if (!process(input_part, priority))
+				break;
 
-			q_packed_parts.push(priority, move(packed_part));
-			packed_part.clear();
-		}
+		mark_completed();
 
-		q_packed_parts.mark_completed();
+		return !failed;
+	}
 
-		return true;
+	bool is_failed() const
+	{
+		return failed;
+	}
+
+	string get_error() const
+	{
+		return error.get();
 	}
 };
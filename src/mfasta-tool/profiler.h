@@ -0,0 +1,333 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+
+#include "memory_stats.h"
+
+#include <refresh/parallel_queues/lib/parallel-queues-common.h>
+
+using namespace std;
+using namespace refresh;
+
+// Statistics of a single queue; all notifications come under the mutex of the queue, so no synchronization is needed
+class CQueueProfile : public IQueueObserver
+{
+public:
+	string name;
+	size_t capacity = 0;
+	size_t cur_items = 0;
+	size_t peak_items = 0;
+	uint64_t no_pushed = 0;
+	uint64_t pushed_bytes = 0;
+	chrono::nanoseconds push_wait{};
+	chrono::nanoseconds pop_wait{};
+
+	void set_queue_params(const std::string& _name, size_t max_size) override
+	{
+		name = _name;
+		capacity = max_size;
+	}
+
+	void notify_pushed() override
+	{
+		++no_pushed;
+		peak_items = std::max(peak_items, ++cur_items);
+	}
+
+	void notify_popped() override
+	{
+		--cur_items;
+	}
+
+	void notify_wait_on_push_time(std::chrono::nanoseconds time) override
+	{
+		push_wait += time;
+	}
+
+	void notify_wait_on_pop_time(std::chrono::nanoseconds time) override
+	{
+		pop_wait += time;
+	}
+
+	void notify_pushed_bytes(size_t bytes) override
+	{
+		pushed_bytes += bytes;
+	}
+};
+
+// Profile of the pipeline: queues are observed, stages are described by their input and output queues.
+// Busy time of a stage is the time of its threads minus the time they waited on pops (input queue) and pushes (output queue)
+// and minus the idle time reported by the stage itself (polls of the shared pool, waits for the turn in the fused section).
+class CPipelineProfiler
+{
+	struct stage_t
+	{
+		string name;
+		string in_queue;
+		string out_queue;
+		uint32_t no_threads;
+		bool scalable;
+		atomic<int64_t> thread_ns{ 0 };
+		atomic<int64_t> idle_ns{ 0 };
+
+		stage_t(const string& name, const string& in_queue, const string& out_queue, uint32_t no_threads, bool scalable) :
+			name(name), in_queue(in_queue), out_queue(out_queue), no_threads(no_threads), scalable(scalable)
+		{}
+	};
+
+	bool enabled;
+	vector<unique_ptr<CQueueProfile>> queues;
+	vector<unique_ptr<stage_t>> stages;
+
+	chrono::high_resolution_clock::time_point t_start;
+	double wall_time = 0;
+
+	CQueueProfile* find_queue(const string& name) const
+	{
+		for (auto& q : queues)
+			if (q->name == name)
+				return q.get();
+
+		return nullptr;
+	}
+
+	stage_t* find_stage(const string& name) const
+	{
+		for (auto& s : stages)
+			if (s->name == name)
+				return s.get();
+
+		return nullptr;
+	}
+
+	static string json_string(const string& s)
+	{
+		string r = "\"";
+
+		for (char c : s)
+		{
+			if (c == '"' || c == '\\')
+				r.push_back('\\');
+			r.push_back(c);
+		}
+
+		return r + "\"";
+	}
+
+	static double seconds(chrono::nanoseconds t)
+	{
+		return t.count() / 1e9;
+	}
+
+public:
+	// Adds thread time to a stage when destroyed
+	class CThreadTimer
+	{
+		stage_t* stage;
+		chrono::high_resolution_clock::time_point t_start;
+
+	public:
+		CThreadTimer(stage_t* stage) :
+			stage(stage),
+			t_start(chrono::high_resolution_clock::now())
+		{}
+
+		CThreadTimer(const CThreadTimer&) = delete;
+
+		~CThreadTimer()
+		{
+			if (stage)
+				stage->thread_ns += chrono::duration_cast<chrono::nanoseconds>(chrono::high_resolution_clock::now() - t_start).count();
+		}
+	};
+
+	CPipelineProfiler(bool enabled) :
+		enabled(enabled)
+	{}
+
+	bool is_enabled() const
+	{
+		return enabled;
+	}
+
+	// Returns nullptr if profiling is disabled; queue sets its name and capacity itself
+	IQueueObserver* queue_observer()
+	{
+		if (!enabled)
+			return nullptr;
+
+		queues.emplace_back(make_unique<CQueueProfile>());
+
+		return queues.back().get();
+	}
+
+	// Empty queue name means that the stage has no such queue; scalable stages can get more (or fewer) threads
+	void add_stage(const string& name, const string& in_queue, const string& out_queue, uint32_t no_threads, bool scalable)
+	{
+		if (enabled)
+			stages.emplace_back(make_unique<stage_t>(name, in_queue, out_queue, no_threads, scalable));
+	}
+
+	// Must be alive for the whole time of the thread working for the stage
+	stage_t* stage(const string& name)
+	{
+		return enabled ? find_stage(name) : nullptr;
+	}
+
+	// Counter of idle time (in ns) for waits that are not seen by the queues; nullptr if profiling is disabled
+	atomic<int64_t>* idle_counter(const string& name)
+	{
+		auto s = stage(name);
+
+		return s ? &s->idle_ns : nullptr;
+	}
+
+	void start()
+	{
+		t_start = chrono::high_resolution_clock::now();
+	}
+
+	void stop()
+	{
+		wall_time = chrono::duration<double>(chrono::high_resolution_clock::now() - t_start).count();
+	}
+
+	// Peak memory of components is added if memory_stats is given
+	bool write_json(const string& file_name, const CMemoryStats* memory_stats = nullptr)
+	{
+		ofstream ofs(file_name);
+
+		if (!ofs)
+		{
+			std::cerr << "Cannot open profile file: " << file_name << endl;
+			return false;
+		}
+
+		struct stage_summary_t
+		{
+			stage_t* stage;
+			double busy;
+			double utilization;
+		};
+
+		vector<stage_summary_t> summaries;
+
+		for (auto& s : stages)
+		{
+			auto q_in = find_queue(s->in_queue);
+			auto q_out = find_queue(s->out_queue);
+
+			double busy = s->thread_ns / 1e9;
+			if (q_in)
+				busy -= seconds(q_in->pop_wait);
+			if (q_out)
+				busy -= seconds(q_out->push_wait);
+			busy -= s->idle_ns / 1e9;
+			busy = std::max(busy, 0.0);
+
+			double utilization = wall_time > 0 ? busy / (wall_time * s->no_threads) : 0.0;
+			summaries.push_back(stage_summary_t{ s.get(), busy, utilization });
+		}
+
+		ofs.precision(6);
+		ofs << fixed;
+
+		ofs << "{\n";
+		ofs << "  \"wall_time_s\": " << wall_time << ",\n";
+
+		ofs << "  \"queues\": [";
+		for (size_t i = 0; i < queues.size(); ++i)
+		{
+			auto& q = *queues[i];
+			ofs << (i ? "," : "") << "\n    {\"name\": " << json_string(q.name) << ", \"capacity\": " << q.capacity
+				<< ", \"items\": " << q.no_pushed << ", \"bytes\": " << q.pushed_bytes << ", \"peak_items\": " << q.peak_items
+				<< ", \"push_wait_s\": " << seconds(q.push_wait) << ", \"pop_wait_s\": " << seconds(q.pop_wait) << "}";
+		}
+		ofs << "\n  ],\n";
+
+		if (memory_stats)
+		{
+			ofs << "  \"memory\": ";
+			memory_stats->write_json(ofs, "  ");
+			ofs << ",\n";
+		}
+
+		ofs << "  \"stages\": [";
+		for (size_t i = 0; i < summaries.size(); ++i)
+		{
+			auto& s = *summaries[i].stage;
+			auto q_in = find_queue(s.in_queue);
+			auto q_out = find_queue(s.out_queue);
+
+			// Items and bytes processed are taken from the input queue (the source has only the output one)
+			auto q_items = q_in ? q_in : q_out;
+
+			ofs << (i ? "," : "") << "\n    {\"name\": " << json_string(s.name) << ", \"threads\": " << s.no_threads
+				<< ", \"thread_time_s\": " << s.thread_ns / 1e9 << ", \"busy_s\": " << summaries[i].busy
+				<< ", \"pop_wait_s\": " << (q_in ? seconds(q_in->pop_wait) : 0.0) << ", \"push_wait_s\": " << (q_out ? seconds(q_out->push_wait) : 0.0)
+				<< ", \"idle_s\": " << s.idle_ns / 1e9
+				<< ", \"items\": " << (q_items ? q_items->no_pushed : 0) << ", \"bytes\": " << (q_items ? q_items->pushed_bytes : 0)
+				<< ", \"peak_queue_items\": " << (q_in ? q_in->peak_items : 0) << ", \"utilization\": " << summaries[i].utilization << "}";
+		}
+		ofs << "\n  ]";
+
+		auto p_limit = max_element(summaries.begin(), summaries.end(), [](const auto& x, const auto& y) {return x.utilization < y.utilization; });
+
+		if (p_limit != summaries.end())
+		{
+			ofs << ",\n  \"limiting_stage\": " << json_string(p_limit->stage->name) << ",\n";
+
+			// Threads of scalable stages are redistributed proportionally to their busy times
+			uint32_t no_scalable_threads = 0;
+			double scalable_busy = 0;
+
+			for (auto& x : summaries)
+				if (x.stage->scalable)
+				{
+					no_scalable_threads += x.stage->no_threads;
+					scalable_busy += x.busy;
+				}
+
+			ofs << "  \"suggested_threads\": {";
+			bool first = true;
+			for (auto& x : summaries)
+				if (x.stage->scalable)
+				{
+					uint32_t suggested = scalable_busy > 0 ? (uint32_t)std::max(1.0, std::round(no_scalable_threads * x.busy / scalable_busy)) : x.stage->no_threads;
+					ofs << (first ? "" : ", ") << json_string(x.stage->name) << ": " << suggested;
+					first = false;
+				}
+			ofs << "},\n";
+
+			string advice;
+			if (!p_limit->stage->scalable)
+				advice = "stage " + p_limit->stage->name + " runs in a single thread, so more threads in other stages would not help";
+			else
+			{
+				auto p_donor = min_element(summaries.begin(), summaries.end(), [](const auto& x, const auto& y) {
+					return !x.stage->scalable ? false : !y.stage->scalable ? true : x.utilization < y.utilization; });
+
+				if (p_donor != p_limit && p_donor->stage->scalable && p_donor->stage->no_threads > 1)
+					advice = "move threads from " + p_donor->stage->name + " to " + p_limit->stage->name;
+				else
+					advice = "more threads for " + p_limit->stage->name + " would help";
+			}
+
+			ofs << "  \"advice\": " << json_string(advice) << "\n";
+		}
+		else
+			ofs << "\n";
+
+		ofs << "}\n";
+
+		return true;
+	}
+};
@@ -0,0 +1,187 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <cinttypes>
+
+using namespace std;
+
+// Counters updated by the stages (once per part or per read buffer) and a thread printing them at a fixed interval.
+// Text mode prints a line for humans, json mode prints one JSON object per line (for job schedulers).
+class CProgress
+{
+	atomic<uint64_t> compressed_bytes{ 0 };
+	atomic<uint64_t> raw_bytes{ 0 };
+	atomic<uint64_t> no_sequences{ 0 };
+	atomic<uint64_t> no_filtered{ 0 };
+	atomic<uint64_t> no_removed{ 0 };
+	atomic<uint64_t> no_parts_written{ 0 };
+	atomic<uint64_t> no_stored{ 0 };
+
+	uint64_t total_bytes = 0;
+	double interval;
+	bool json;
+
+	thread t_reporter;
+	mutex mtx;
+	condition_variable cv;
+	bool stopped = false;
+	bool failed = false;
+
+	chrono::steady_clock::time_point t_start;
+
+	struct sample_t
+	{
+		double time = 0;
+		uint64_t compressed_bytes = 0;
+		uint64_t raw_bytes = 0;
+		uint64_t no_sequences = 0;
+	};
+
+	sample_t take_sample()
+	{
+		return sample_t{ chrono::duration<double>(chrono::steady_clock::now() - t_start).count(), compressed_bytes, raw_bytes, no_sequences };
+	}
+
+	// After a failure the final line keeps the reached fraction and is marked as failed instead of done
+	void report(const sample_t& prev, const sample_t& curr, bool done, bool failed = false)
+	{
+		double dt = std::max(curr.time - prev.time, 1e-9);
+		double raw_rate = (curr.raw_bytes - prev.raw_bytes) / dt / 1e6;
+		double seq_rate = (curr.no_sequences - prev.no_sequences) / dt;
+		uint64_t filtered = no_filtered;
+		uint64_t removed = no_removed;
+		double dup_ratio = filtered ? (double)removed / filtered : 0.0;
+
+		// Input is read ahead of processing, so the fraction of read input is scaled by the fraction of read sequences
+		// that are already completed (stored or removed as duplicates)
+		double fraction = 0;
+		if (done)
+			fraction = 1.0;
+		else if (total_bytes && curr.no_sequences)
+			fraction = std::min(1.0, (double)curr.compressed_bytes / total_bytes) * std::min(1.0, (double)(no_stored + removed) / curr.no_sequences);
+
+		// ETA from the average rate, as the current rate is noisy
+		double eta = -1;
+		if (done)
+			eta = 0;
+		else if (fraction > 0 && !failed)
+			eta = curr.time * (1.0 - fraction) / fraction;
+
+		ostringstream oss;
+		oss << fixed;
+
+		if (json)
+			oss << setprecision(3) << "{\"elapsed_s\": " << curr.time << ", \"input_bytes_read\": " << curr.compressed_bytes << ", \"input_bytes_total\": " << total_bytes
+				<< ", \"fraction\": " << fraction << ", \"raw_mb_per_s\": " << raw_rate << ", \"seq_per_s\": " << seq_rate
+				<< ", \"sequences\": " << curr.no_sequences << ", \"sequences_done\": " << no_stored + removed << ", \"parts_written\": " << no_parts_written << ", \"dup_ratio\": " << dup_ratio
+				<< ", \"eta_s\": " << eta << ", \"done\": " << (done ? "true" : "false") << ", \"failed\": " << (failed ? "true" : "false") << "}\n";
+		else
+		{
+			oss << setprecision(1) << "Progress: " << 100 * fraction << "% (" << (curr.compressed_bytes >> 20) << "/" << (total_bytes >> 20) << " MB read), "
+				<< raw_rate << " MB/s, " << setprecision(0) << seq_rate << " seq/s, " << curr.no_sequences << " sequences (" << no_stored + removed << " done), "
+				<< no_parts_written << " parts written";
+			if (filtered)
+				oss << setprecision(1) << ", duplicates " << 100 * dup_ratio << "%";
+			oss << setprecision(0) << ", elapsed " << curr.time << " s";
+			if (failed)
+				oss << ", failed";
+			else if (eta >= 0)
+				oss << ", ETA " << eta << " s";
+			oss << "\n";
+		}
+
+		// Single write, so lines are not mixed with messages of other threads
+		std::cerr << oss.str() << flush;
+	}
+
+	void reporter()
+	{
+		sample_t prev;
+		unique_lock<mutex> lck(mtx);
+
+		while (!cv.wait_for(lck, chrono::duration<double>(interval), [this] {return stopped; }))
+		{
+			auto curr = take_sample();
+			report(prev, curr, false);
+			prev = curr;
+		}
+
+		report(sample_t{}, take_sample(), !failed, failed);
+	}
+
+public:
+	CProgress(const vector<string>& in_names, double interval, bool json) :
+		interval(interval),
+		json(json)
+	{
+		for (const auto& fn : in_names)
+		{
+			error_code ec;
+			auto size = filesystem::file_size(fn, ec);
+			if (!ec)
+				total_bytes += size;
+		}
+	}
+
+	~CProgress()
+	{
+		stop();
+	}
+
+	void start()
+	{
+		t_start = chrono::steady_clock::now();
+		t_reporter = thread([this] { reporter(); });
+	}
+
+	// Prints the final line; ok should be false if the processing failed
+	void stop(bool ok = true)
+	{
+		{
+			lock_guard<mutex> lck(mtx);
+			stopped = true;
+			failed = !ok;
+		}
+		cv.notify_all();
+
+		if (t_reporter.joinable())
+			t_reporter.join();
+	}
+
+	void add_compressed(uint64_t bytes)
+	{
+		compressed_bytes.fetch_add(bytes, memory_order_relaxed);
+	}
+
+	void add_parsed(uint64_t bytes, uint64_t sequences)
+	{
+		raw_bytes.fetch_add(bytes, memory_order_relaxed);
+		no_sequences.fetch_add(sequences, memory_order_relaxed);
+	}
+
+	void add_filtered(uint64_t sequences, uint64_t removed)
+	{
+		no_filtered.fetch_add(sequences, memory_order_relaxed);
+		no_removed.fetch_add(removed, memory_order_relaxed);
+	}
+
+	void add_stored(uint64_t sequences)
+	{
+		no_stored.fetch_add(sequences, memory_order_relaxed);
+	}
+
+	void add_part_written()
+	{
+		no_parts_written.fetch_add(1, memory_order_relaxed);
+	}
+};
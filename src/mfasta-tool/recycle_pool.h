@@ -0,0 +1,78 @@
+#pragma once
+
+#include <vector>
+#include <mutex>
+#include <atomic>
+
+#include "defs.h"
+#include "memory_stats.h"
+
+using namespace std;
+
+// Return queue for emptied objects (parts, buffers), so their memory can be reused by the producer
+// instead of being freed by the consumer thread and allocated again
+template<typename T>
+class CRecyclePool
+{
+	mutex mtx;
+	vector<T> items;
+	size_t max_items;
+
+	atomic<uint64_t> no_hits{ 0 };
+	atomic<uint64_t> no_misses{ 0 };
+
+	CMemoryCounter* memory_counter;
+
+public:
+	// Bytes of objects kept in the pool are added to memory_counter (if given)
+	CRecyclePool(size_t max_items, CMemoryCounter* memory_counter = nullptr) :
+		max_items(max_items),
+		memory_counter(memory_counter)
+	{
+		items.reserve(max_items);
+	}
+
+	// Returns false if there is no object to reuse
+	bool get(T& item)
+	{
+		lock_guard<mutex> lck(mtx);
+
+		if (items.empty())
+		{
+			++no_misses;
+			return false;
+		}
+
+		item = move(items.back());
+		items.pop_back();
+		++no_hits;
+
+		if (memory_counter)
+			memory_counter->add(-(int64_t)footprint(item));
+
+		return true;
+	}
+
+	// When the pool is full the object is left to the caller
+	bool put(T&& item)
+	{
+		lock_guard<mutex> lck(mtx);
+
+		if (items.size() >= max_items)
+			return false;
+
+		if (memory_counter)
+			memory_counter->add(footprint(item));
+
+		items.emplace_back(move(item));
+
+		return true;
+	}
+
+	double hit_rate() const
+	{
+		uint64_t total = no_hits + no_misses;
+
+		return total ? (double)no_hits / total : 0.0;
+	}
+};
@@ -12,6 +12,10 @@
 #include "params.h"
 #include "utils.h"
 #include "sha256.h"
+#include "trace.h"
+#include "progress.h"
+#include "memory_stats.h"
+#include "error_state.h"
 
 #include <refresh/parallel_queues/lib/parallel-queues.h>
 
@@ -132,21 +136,42 @@ public:
 		bases_mapping['t'] = 'a';
 	}
 
+	void hash_part(input_part_t& input_part)
+	{
+		for (auto& item : input_part)
+			add_hash(item);
+	}
+
+	// Hashes a single part and passes it to the next stage; returns false if the pipeline was canceled
+	bool process(input_part_t& input_part, uint64_t priority)
+	{
+		{
+			CTraceSpan span("hash", priority, "input_part");
+			hash_part(input_part);
+		}
+
+		CTraceSpan span("push", priority, "input_part");
+		bool r = q_hashed_parts.push_or_cancel(priority, move(input_part));
+		input_part.clear();
+
+		return r;
+	}
+
+	void mark_completed()
+	{
+		q_hashed_parts.mark_completed();
+	}
+
 	bool run()
 	{
 		uint64_t priority;
 		input_part_t input_part;
 
 		while (q_input_parts.pop(input_part, priority))
-		{
-			for (auto& item : input_part)
-				add_hash(item);
+			if (!process(input_part, priority))
+				break;
 
-			q_hashed_parts.push(priority, move(input_part));
-			input_part.clear();
-		}
-
-		q_hashed_parts.mark_completed();
+		mark_completed();
 
 		return true;
 	}
@@ -160,22 +185,25 @@ class CSHA256Filter
 	parallel_priority_queue<input_part_t>& q_filtered_parts;
 	string out_log_fn;
 	size_t no_seq_in_part;
+	ofstream ofs;
+	CProgress* progress;
+	CMemoryStats* memory_stats;
 
 	unordered_map<sha256_t, list<pair<bool, string>>> dict;
+	size_t dict_nodes_bytes = 0;			// estimated, without the bucket array
 
 	size_t no_unique, no_duplicated, no_removed;
+	CStageError error;
 
-	string strip_id(const string& s)
+	string prepare_id(const string& id, const string& prefix)
 	{
-		vector<char> term_symbols = { ' ', '\t', '\n' };
-		auto p = find_first_of(s.begin(), s.end(), term_symbols.begin(), term_symbols.end());
-
-		return string(s.begin(), p);
+		return build_new_id(strip_id(id), prefix);
 	}
 
-	string prepare_id(const string& id, const string& prefix)
+	// List node with id; ids longer than the small string buffer are allocated separately
+	static size_t id_node_bytes(const string& id)
 	{
-		return build_new_id(strip_id(id), prefix);
+		return 2 * sizeof(void*) + sizeof(pair<bool, string>) + (id.capacity() > string().capacity() ? id.capacity() + 1 : 0);
 	}
 
 	// Return false if duplicated
@@ -186,10 +214,15 @@ class CSHA256Filter
 		if (p != dict.end())
 		{
 			p->second.emplace_back(input_item.hash_orientation_fwd, prepare_id(input_item.id, input_item.prefix));
+			dict_nodes_bytes += id_node_bytes(p->second.back().second);
 			return false;
 		}
 
-		dict[input_item.hash].emplace_back(input_item.hash_orientation_fwd, prepare_id(input_item.id, input_item.prefix));
+		auto& ids = dict[input_item.hash];
+		ids.emplace_back(input_item.hash_orientation_fwd, prepare_id(input_item.id, input_item.prefix));
+
+		// Map node: next pointer, key, list and cached hash
+		dict_nodes_bytes += sizeof(void*) + sizeof(pair<const sha256_t, list<pair<bool, string>>>) + sizeof(size_t) + id_node_bytes(ids.back().second);
 		return true;
 	}
 
@@ -236,54 +269,102 @@ class CSHA256Filter
 public:
 	CSHA256Filter(bool rev_comp_as_equivalent, bool mark_duplicates_orientation,
 		parallel_priority_queue<input_part_t>& q_input_parts, parallel_priority_queue<input_part_t>& q_filtered_parts,
-		const string &out_log_fn, const size_t no_seq_in_part) :
+		const string &out_log_fn, const size_t no_seq_in_part, CProgress* progress = nullptr, CMemoryStats* memory_stats = nullptr) :
 		rev_comp_as_equivalent(rev_comp_as_equivalent),
 		mark_duplicates_orientation(mark_duplicates_orientation),
 		q_input_parts(q_input_parts),
 		q_filtered_parts(q_filtered_parts),
 		out_log_fn(out_log_fn),
-		no_seq_in_part(no_seq_in_part)
-	{}
+		no_seq_in_part(no_seq_in_part),
+		progress(progress),
+		memory_stats(memory_stats)
+	{
+		dict.max_load_factor(1.0);
+	}
 
-	bool run()
+	// Log file is opened in advance to not find out about the problem after processing all data
+	bool open_log()
 	{
-		input_part_t input_part;
-		input_part_t filtered_part;
-		uint64_t priority;
+		if (out_log_fn.empty())
+			return true;
 
-		dict.max_load_factor(1.0);
+		ofs.open(out_log_fn, std::ios::binary);
 
-		while (q_input_parts.pop(input_part, priority))
+		if (!ofs)
 		{
-			for (auto& item : input_part)
-				if (!add_to_dict(item))
-					item.lines.clear();
+			error.set("cannot open duplicated log file: " + out_log_fn);
+			return false;
+		}
 
-			input_part.erase(remove_if(input_part.begin(), input_part.end(), [](const auto& x) {return x.lines.empty(); }), input_part.end());
+		return true;
+	}
 
-			q_filtered_parts.push(priority, move(input_part));
-		}
+	// Removes items of already seen sequences; parts must be given in order, as the first occurrence is preserved
+	void filter(input_part_t& input_part)
+	{
+		size_t no_items = input_part.size();
 
-		q_filtered_parts.mark_completed();
+		for (auto& item : input_part)
+			if (!add_to_dict(item))
+				item.lines.clear();
+
+		input_part.erase(remove_if(input_part.begin(), input_part.end(), [](const auto& x) {return x.lines.empty(); }), input_part.end());
 
+		if (progress)
+			progress->add_filtered(no_items, no_items - input_part.size());
+
+		if (memory_stats)
+		{
+			memory_stats->dict_entries.set(dict.size());
+			memory_stats->dict_bytes.set(dict_nodes_bytes + dict.bucket_count() * sizeof(void*));
+		}
+	}
+
+	void write_log()
+	{
 		if(out_log_fn.empty())
 			store_log(cout);
 		else
+			store_log(ofs);
+	}
+
+	bool run()
+	{
+		input_part_t input_part;
+		uint64_t priority;
+
+		if (!open_log())
 		{
-			ofstream ofs(out_log_fn, std::ios::binary);
+			q_filtered_parts.mark_completed();
+			return false;
+		}
 
-			if (!ofs)
+		while (q_input_parts.pop(input_part, priority))
+		{
 			{
-				std::cerr << "Cannot open duplicated log file: " << out_log_fn << endl;
-				return false;
+				CTraceSpan span("filter", priority, "input_part");
+				filter(input_part);
 			}
 
-			store_log(ofs);
+			if (!q_filtered_parts.push_or_cancel(priority, move(input_part)))
+				break;
 		}
 
+		q_filtered_parts.mark_completed();
+
+		if (q_input_parts.is_canceled() || q_filtered_parts.is_canceled())
+			return true;
+
+		write_log();
+
 		return true;
 	}
 
+	string get_error() const
+	{
+		return error.get();
+	}
+
 	void get_stats(size_t& _no_unique, size_t& _no_duplicated, size_t& _no_removed)
 	{
 		_no_unique = no_unique;
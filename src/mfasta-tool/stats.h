@@ -0,0 +1,417 @@
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <array>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <iomanip>
+
+#include "params.h"
+#include "defs.h"
+#include "data_source.h"
+#include "recycle_pool.h"
+#include "system_info.h"
+#include "error_state.h"
+
+#include <refresh/parallel_queues/lib/parallel-queues.h>
+
+using namespace std;
+using namespace refresh;
+
+// Statistics of a collection of records (single input file or all of them)
+struct seq_stats_t
+{
+	enum base_t { A, C, G, T, N, other, no_bases };
+
+	static const int no_length_bins = 48;		// bin i: lengths in [2^i, 2^(i+1)), bin 0 contains also empty records
+
+	uint64_t no_records = 0;
+	uint64_t total_length = 0;
+	uint64_t min_length = ~0ull;
+	uint64_t max_length = 0;
+	array<uint64_t, no_bases> bases{};
+	array<uint64_t, no_length_bins> length_hist{};
+	vector<uint64_t> lengths;
+
+	// Summary computed by finalize()
+	uint64_t n50 = 0, l50 = 0, n90 = 0, l90 = 0;
+
+	void add_record(uint64_t length)
+	{
+		++no_records;
+		total_length += length;
+		min_length = std::min(min_length, length);
+		max_length = std::max(max_length, length);
+		lengths.emplace_back(length);
+
+		int bin = 0;
+		for (uint64_t x = length; x > 1 && bin < no_length_bins - 1; x >>= 1)
+			++bin;
+		++length_hist[bin];
+	}
+
+	void merge(const seq_stats_t& rhs)
+	{
+		no_records += rhs.no_records;
+		total_length += rhs.total_length;
+		min_length = std::min(min_length, rhs.min_length);
+		max_length = std::max(max_length, rhs.max_length);
+
+		for (int i = 0; i < no_bases; ++i)
+			bases[i] += rhs.bases[i];
+		for (int i = 0; i < no_length_bins; ++i)
+			length_hist[i] += rhs.length_hist[i];
+
+		lengths.insert(lengths.end(), rhs.lengths.begin(), rhs.lengths.end());
+	}
+
+	// Nx is the length of the shortest record such that records not shorter than it cover x% of bases; Lx is the no. of such records
+	void finalize()
+	{
+		sort(lengths.begin(), lengths.end(), greater<uint64_t>());
+
+		uint64_t sum = 0;
+		n50 = l50 = n90 = l90 = 0;
+
+		for (size_t i = 0; i < lengths.size(); ++i)
+		{
+			sum += lengths[i];
+
+			if (!l50 && 2 * sum >= total_length)
+			{
+				n50 = lengths[i];
+				l50 = i + 1;
+			}
+
+			if (!l90 && 10 * sum >= 9 * total_length)
+			{
+				n90 = lengths[i];
+				l90 = i + 1;
+				break;
+			}
+		}
+
+		lengths.clear();
+		lengths.shrink_to_fit();
+	}
+
+	double gc_percent() const
+	{
+		uint64_t acgt = bases[A] + bases[C] + bases[G] + bases[T];
+
+		return acgt ? 100.0 * (bases[C] + bases[G]) / acgt : 0.0;
+	}
+};
+
+// Counts bases of records of parts. Bytes are counted in 4 interleaved tables (consecutive equal bytes do not wait for
+// the same counter), which are folded to classes of bases once per part, so the inner loop has no branches.
+class CStatsWorker
+{
+	parallel_priority_queue<input_part_t>& q_input_parts;
+	CRecyclePool<input_part_t>* input_part_pool;
+
+	vector<seq_stats_t> file_stats;			// indexed by file_id
+	array<array<uint32_t, 256>, 4> byte_counts{};
+	uint64_t counted_bytes = 0;
+	uint32_t counted_file_id = 0;
+
+	static const array<uint8_t, 256>& base_classes()
+	{
+		static const array<uint8_t, 256> classes = [] {
+			array<uint8_t, 256> r;
+			r.fill(seq_stats_t::other);
+			r['A'] = r['a'] = seq_stats_t::A;
+			r['C'] = r['c'] = seq_stats_t::C;
+			r['G'] = r['g'] = seq_stats_t::G;
+			r['T'] = r['t'] = seq_stats_t::T;
+			r['N'] = r['n'] = seq_stats_t::N;
+			return r;
+			}();
+
+		return classes;
+	}
+
+	seq_stats_t& get_file_stats(uint32_t file_id)
+	{
+		if (file_id >= file_stats.size())
+			file_stats.resize(file_id + 1);
+
+		return file_stats[file_id];
+	}
+
+	void count_line(const string& line)
+	{
+		const uint8_t* p = (const uint8_t*) line.data();
+		size_t n = line.size();
+		size_t i = 0;
+
+		auto& c0 = byte_counts[0];
+		auto& c1 = byte_counts[1];
+		auto& c2 = byte_counts[2];
+		auto& c3 = byte_counts[3];
+
+		for (; i + 4 <= n; i += 4)
+		{
+			++c0[p[i]];
+			++c1[p[i + 1]];
+			++c2[p[i + 2]];
+			++c3[p[i + 3]];
+		}
+
+		for (; i < n; ++i)
+			++c0[p[i]];
+
+		counted_bytes += n;
+	}
+
+	void flush_counts()
+	{
+		if (!counted_bytes)
+			return;
+
+		auto& stats = get_file_stats(counted_file_id);
+		const auto& classes = base_classes();
+
+		for (int b = 0; b < 256; ++b)
+		{
+			uint64_t x = (uint64_t) byte_counts[0][b] + byte_counts[1][b] + byte_counts[2][b] + byte_counts[3][b];
+			stats.bases[classes[b]] += x;
+		}
+
+		for (auto& c : byte_counts)
+			c.fill(0);
+
+		counted_bytes = 0;
+	}
+
+	void process_part(const input_part_t& part)
+	{
+		for (const auto& item : part)
+		{
+			// Counts are kept per file and 32-bit counters must not overflow
+			if (item.file_id != counted_file_id || counted_bytes >= (1ull << 31))
+			{
+				flush_counts();
+				counted_file_id = item.file_id;
+			}
+
+			uint64_t length = 0;
+
+			for (const auto& line : item.lines)
+			{
+				count_line(line);
+				length += line.size();
+			}
+
+			// Parts come directly from the data source (not the partitioner), so records are never split into fragments
+			get_file_stats(item.file_id).add_record(length);
+		}
+
+		flush_counts();
+	}
+
+public:
+	CStatsWorker(parallel_priority_queue<input_part_t>& q_input_parts, CRecyclePool<input_part_t>* input_part_pool = nullptr) :
+		q_input_parts(q_input_parts),
+		input_part_pool(input_part_pool)
+	{}
+
+	bool run()
+	{
+		input_part_t part;
+		uint64_t priority;
+
+		while (q_input_parts.pop(part, priority))
+		{
+			process_part(part);
+
+			if (input_part_pool)
+				input_part_pool->put(move(part));
+			part.clear();
+		}
+
+		return true;
+	}
+
+	const vector<seq_stats_t>& get_file_stats() const
+	{
+		return file_stats;
+	}
+};
+
+// **************************************************
+inline void write_stats_tsv(ostream& os, const vector<string>& names, const vector<seq_stats_t>& stats)
+{
+	os << "file\trecords\tbases\tmin_len\tmax_len\tmean_len\tN50\tL50\tN90\tL90\tA\tC\tG\tT\tN\tother\tgc_percent\tlen_hist_log2\n";
+	os << fixed << setprecision(2);
+
+	for (size_t i = 0; i < stats.size(); ++i)
+	{
+		const auto& s = stats[i];
+
+		// Histogram is given up to the last non-empty bin
+		int last_bin = seq_stats_t::no_length_bins - 1;
+		while (last_bin > 0 && s.length_hist[last_bin] == 0)
+			--last_bin;
+
+		os << names[i] << "\t" << s.no_records << "\t" << s.total_length << "\t" << (s.no_records ? s.min_length : 0) << "\t" << s.max_length << "\t"
+			<< (s.no_records ? (double) s.total_length / s.no_records : 0.0) << "\t" << s.n50 << "\t" << s.l50 << "\t" << s.n90 << "\t" << s.l90;
+
+		for (auto x : s.bases)
+			os << "\t" << x;
+
+		os << "\t" << s.gc_percent() << "\t";
+
+		for (int j = 0; j <= last_bin; ++j)
+			os << (j ? "," : "") << s.length_hist[j];
+
+		os << "\n";
+	}
+}
+
+// **************************************************
+inline void write_stats_json(ostream& os, const vector<string>& names, const vector<seq_stats_t>& stats)
+{
+	auto json_string = [](const string& s) {
+		string r = "\"";
+		for (char c : s)
+		{
+			if (c == '"' || c == '\\')
+				r.push_back('\\');
+			r.push_back(c);
+		}
+		return r + "\"";
+		};
+
+	const char* base_names[] = { "A", "C", "G", "T", "N", "other" };
+
+	os << fixed << setprecision(2);
+	os << "[";
+
+	for (size_t i = 0; i < stats.size(); ++i)
+	{
+		const auto& s = stats[i];
+
+		os << (i ? "," : "") << "\n  {\"file\": " << json_string(names[i]) << ", \"records\": " << s.no_records << ", \"bases\": " << s.total_length
+			<< ", \"min_len\": " << (s.no_records ? s.min_length : 0) << ", \"max_len\": " << s.max_length
+			<< ", \"mean_len\": " << (s.no_records ? (double) s.total_length / s.no_records : 0.0)
+			<< ", \"N50\": " << s.n50 << ", \"L50\": " << s.l50 << ", \"N90\": " << s.n90 << ", \"L90\": " << s.l90 << ",\n   \"composition\": {";
+
+		for (int j = 0; j < seq_stats_t::no_bases; ++j)
+			os << (j ? ", " : "") << "\"" << base_names[j] << "\": " << s.bases[j];
+
+		os << "}, \"gc_percent\": " << s.gc_percent() << ",\n   \"length_histogram\": [";
+
+		bool first = true;
+		for (int j = 0; j < seq_stats_t::no_length_bins; ++j)
+			if (s.length_hist[j])
+			{
+				os << (first ? "" : ", ") << "{\"min\": " << (j ? 1ull << j : 0) << ", \"max\": " << (1ull << (j + 1)) - 1 << ", \"count\": " << s.length_hist[j] << "}";
+				first = false;
+			}
+
+		os << "]}";
+	}
+
+	os << "\n]\n";
+}
+
+// **************************************************
+// Reads input files in a single thread (as in mrds) and counts parts in a pool of workers; per-file statistics
+// of workers are merged at the end, the last row is for all files
+inline bool process_stats(const CParams& params)
+{
+	uint32_t n_requested_threads = params.no_threads ? params.no_threads : get_available_cores();
+	uint32_t n_workers = std::max<uint32_t>(1, n_requested_threads > 1 ? n_requested_threads - 1 : 1);
+	atomic<bool> is_ok = true;
+
+	parallel_priority_queue<input_part_t> q_input_parts(params.input_queue_max_size, 1, "input");
+
+	// Order of parts does not matter
+	q_input_parts.set_unordered(true);
+
+	CRecyclePool<input_part_t> input_part_pool(params.recycle_pool_size);
+
+	CErrorState error_state;
+	error_state.add_cancel_callback([&q_input_parts] {
+		q_input_parts.cancel();
+		});
+
+	auto fail = [&is_ok, &error_state](const string& stage, const string& message = "") {
+		is_ok = false;
+		error_state.report(stage, message);
+		};
+
+	thread t_data_source([&params, &fail, &q_input_parts, &input_part_pool] {
+		CDataSource data_source(params.in_names, params.in_prefixes, q_input_parts, true, params.data_source_input_parts_size, params.soft_limit_size_in_part, params.verbosity,
+			nullptr, &input_part_pool, nullptr, nullptr, params.inflate_engine);
+		if (!data_source.run())
+			fail("data source", data_source.get_error());
+		});
+
+	vector<unique_ptr<CStatsWorker>> workers;
+	vector<thread> vt_workers;
+
+	for (uint32_t i = 0; i < n_workers; ++i)
+	{
+		workers.emplace_back(make_unique<CStatsWorker>(q_input_parts, &input_part_pool));
+		vt_workers.emplace_back([&fail, worker = workers.back().get()] {
+			if (!worker->run())
+				fail("stats worker");
+			});
+	}
+
+	t_data_source.join();
+	for (auto& t : vt_workers)
+		t.join();
+
+	if (!is_ok)
+	{
+		std::cerr << "Error: " << error_state.get_first_error() << endl;
+		return false;
+	}
+
+	vector<seq_stats_t> stats(params.in_names.size() + 1);
+
+	for (auto& worker : workers)
+	{
+		const auto& file_stats = worker->get_file_stats();
+		for (size_t i = 0; i < file_stats.size(); ++i)
+			stats[i].merge(file_stats[i]);
+	}
+	workers.clear();
+
+	for (size_t i = 0; i < params.in_names.size(); ++i)
+		stats.back().merge(stats[i]);
+
+	for (auto& s : stats)
+		s.finalize();
+
+	vector<string> names = params.in_names;
+	names.emplace_back("total");
+
+	ofstream ofs;
+	if (!params.out_name.empty())
+	{
+		ofs.open(params.out_name);
+		if (!ofs)
+		{
+			std::cerr << "Cannot open output file: " << params.out_name << endl;
+			return false;
+		}
+	}
+
+	ostream& os = params.out_name.empty() ? cout : ofs;
+
+	if (params.stats_json)
+		write_stats_json(os, names, stats);
+	else
+		write_stats_tsv(os, names, stats);
+
+	return true;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <thread>
+#include <fstream>
+#include <string>
+#include <algorithm>
+#include <cmath>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+using namespace std;
+
+// No. of cores the process can use: hardware threads limited by the affinity mask and cgroup CPU quota
+inline uint32_t get_available_cores()
+{
+	uint32_t n = std::max(1u, thread::hardware_concurrency());
+
+#ifdef __linux__
+	cpu_set_t cpu_set;
+	CPU_ZERO(&cpu_set);
+	if (sched_getaffinity(0, sizeof(cpu_set), &cpu_set) == 0)
+		n = std::min<uint32_t>(n, std::max(1, CPU_COUNT(&cpu_set)));
+
+	auto apply_quota = [&n](double quota, double period) {
+		if (quota > 0 && period > 0)
+			n = std::min<uint32_t>(n, std::max<uint32_t>(1, (uint32_t)ceil(quota / period)));
+		};
+
+	// cgroup v2
+	ifstream ifs_v2("/sys/fs/cgroup/cpu.max");
+	string quota;
+	double period;
+
+	if (ifs_v2 >> quota >> period)
+	{
+		if (quota != "max")
+			apply_quota(stod(quota), period);
+	}
+	else
+	{
+		// cgroup v1 (quota -1 means no limit)
+		ifstream ifs_quota("/sys/fs/cgroup/cpu/cpu.cfs_quota_us");
+		ifstream ifs_period("/sys/fs/cgroup/cpu/cpu.cfs_period_us");
+		double quota_v1;
+
+		if (ifs_quota >> quota_v1 && ifs_period >> period)
+			apply_quota(quota_v1, period);
+	}
+#endif
+
+	return n;
+}
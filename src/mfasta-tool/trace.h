@@ -0,0 +1,216 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <cinttypes>
+
+using namespace std;
+
+class CTracer;
+
+// Span of work on a single part
+struct trace_event_t
+{
+	const char* name;			// static strings only, so recording needs no allocation
+	const char* key;
+	uint64_t id;
+	int64_t start_ns;
+	int64_t dur_ns;
+};
+
+// Events of a single thread; when full, the oldest events are overwritten
+class CTraceBuffer
+{
+	vector<trace_event_t> events;
+	size_t pos = 0;
+	bool wrapped = false;
+
+public:
+	CTracer* tracer;
+	string thread_name;
+	uint32_t tid;
+
+	CTraceBuffer(CTracer* tracer, const string& thread_name, uint32_t tid, size_t capacity) :
+		events(capacity),
+		tracer(tracer),
+		thread_name(thread_name),
+		tid(tid)
+	{}
+
+	void add(const trace_event_t& event)
+	{
+		events[pos] = event;
+
+		if (++pos == events.size())
+		{
+			pos = 0;
+			wrapped = true;
+		}
+	}
+
+	// Calls f for the stored events in order of recording
+	template<typename F>
+	void for_each(F f) const
+	{
+		if (wrapped)
+			for (size_t i = pos; i < events.size(); ++i)
+				f(events[i]);
+
+		for (size_t i = 0; i < pos; ++i)
+			f(events[i]);
+	}
+
+	// Buffer of the calling thread (nullptr if the thread is not traced)
+	static CTraceBuffer*& current()
+	{
+		thread_local CTraceBuffer* buffer = nullptr;
+		return buffer;
+	}
+};
+
+// Collects per-thread buffers and writes them as Chrome trace-event JSON (chrome://tracing, Perfetto)
+class CTracer
+{
+	bool enabled;
+	size_t events_per_thread;
+	chrono::steady_clock::time_point t_start;
+
+	mutex mtx;
+	vector<unique_ptr<CTraceBuffer>> buffers;
+
+public:
+	CTracer(bool enabled, size_t events_per_thread = 1 << 16) :
+		enabled(enabled),
+		events_per_thread(events_per_thread),
+		t_start(chrono::steady_clock::now())
+	{}
+
+	bool is_enabled() const
+	{
+		return enabled;
+	}
+
+	int64_t now_ns() const
+	{
+		return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - t_start).count();
+	}
+
+	CTraceBuffer* register_thread(const string& thread_name)
+	{
+		lock_guard<mutex> lck(mtx);
+		buffers.emplace_back(make_unique<CTraceBuffer>(this, thread_name, (uint32_t) buffers.size() + 1, events_per_thread));
+
+		return buffers.back().get();
+	}
+
+	// Must be called after all traced threads finished
+	bool write_json(const string& file_name)
+	{
+		ofstream ofs(file_name);
+
+		if (!ofs)
+		{
+			std::cerr << "Cannot open trace file: " << file_name << endl;
+			return false;
+		}
+
+		lock_guard<mutex> lck(mtx);
+		bool first = true;
+
+		auto sep = [&first, &ofs] {
+			ofs << (first ? "\n" : ",\n");
+			first = false;
+			};
+
+		ofs << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+
+		for (const auto& buffer : buffers)
+		{
+			sep();
+			ofs << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << buffer->tid << ", \"args\": {\"name\": \"" << buffer->thread_name << "\"}}";
+
+			buffer->for_each([&](const trace_event_t& e) {
+				sep();
+				ofs << "{\"name\": \"" << e.name << "\", \"cat\": \"" << buffer->thread_name << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << buffer->tid
+					<< ", \"ts\": " << e.start_ns / 1000 << "." << (e.start_ns % 1000) / 100
+					<< ", \"dur\": " << e.dur_ns / 1000 << "." << (e.dur_ns % 1000) / 100
+					<< ", \"args\": {\"" << e.key << "\": " << e.id << "}}";
+				});
+		}
+
+		ofs << "\n]}\n";
+
+		return true;
+	}
+};
+
+// Makes the calling thread traced (for its lifetime); no-op if tracer is nullptr or disabled
+class CTraceThread
+{
+public:
+	CTraceThread(CTracer* tracer, const string& thread_name)
+	{
+		if (tracer && tracer->is_enabled())
+			CTraceBuffer::current() = tracer->register_thread(thread_name);
+	}
+
+	CTraceThread(const CTraceThread&) = delete;
+
+	~CTraceThread()
+	{
+		CTraceBuffer::current() = nullptr;
+	}
+
+	// Tracer of the calling thread, to be passed to threads started by it
+	static CTracer* tracer()
+	{
+		auto buffer = CTraceBuffer::current();
+		return buffer ? buffer->tracer : nullptr;
+	}
+};
+
+// Records the time from construction to destruction; costs only a check of a thread-local pointer if the thread is not traced
+class CTraceSpan
+{
+	CTraceBuffer* buffer;
+	trace_event_t event;
+
+public:
+	CTraceSpan(const char* name, uint64_t id, const char* key = "part") :
+		buffer(CTraceBuffer::current())
+	{
+		if (buffer)
+			event = trace_event_t{ name, key, id, buffer->tracer->now_ns(), 0 };
+	}
+
+	CTraceSpan(const CTraceSpan&) = delete;
+
+	~CTraceSpan()
+	{
+		if (buffer)
+		{
+			event.dur_ns = buffer->tracer->now_ns() - event.start_ns;
+			buffer->add(event);
+		}
+	}
+};
+
+// For spans not matching a scope: start = trace_now() at the beginning, trace_add(...) at the end
+inline int64_t trace_now()
+{
+	auto buffer = CTraceBuffer::current();
+	return buffer ? buffer->tracer->now_ns() : 0;
+}
+
+inline void trace_add(const char* name, uint64_t id, int64_t start_ns, const char* key = "part")
+{
+	auto buffer = CTraceBuffer::current();
+
+	if (buffer)
+		buffer->add(trace_event_t{ name, key, id, start_ns, buffer->tracer->now_ns() - start_ns });
+}
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <string>
+#include <vector>
+#include <algorithm>
 
 using namespace std;
 
@@ -13,4 +15,18 @@ inline string build_new_id(const string& id, const string& prefix)
 	s.insert(s.end(), id.begin() + 1, id.end());
 
 	return s;
-}
\ No newline at end of file
+}
+
+// Identifier is terminated by the first space, tab or new line
+inline size_t id_length(const string& s)
+{
+	static const char term_symbols[] = { ' ', '\t', '\n' };
+	auto p = find_first_of(s.begin(), s.end(), begin(term_symbols), end(term_symbols));
+
+	return p - s.begin();
+}
+
+inline string strip_id(const string& s)
+{
+	return s.substr(0, id_length(s));
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include "defs.h"
+
+#include <iostream>
+
+#ifdef REFRESH_USE_ZSTD
+#include <zstd.h>
+
+// Compression of parts into zstd frames
+class CZstdCompressor
+{
+	ZSTD_CCtx* cctx = nullptr;
+	int compression_level;
+	int no_workers;
+	string error;
+
+public:
+	CZstdCompressor(int compression_level, int no_workers) :
+		compression_level(std::clamp(compression_level, ZSTD_minCLevel(), ZSTD_maxCLevel())),
+		no_workers(no_workers)
+	{
+		cctx = ZSTD_createCCtx();
+
+		ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, this->compression_level);
+		ZSTD_CCtx_setParameter(cctx, ZSTD_c_checksumFlag, 1);
+
+		// Fails silently (single-threaded compression) if zstd was built without multithreading support
+		if (no_workers > 0)
+			ZSTD_CCtx_setParameter(cctx, ZSTD_c_nbWorkers, no_workers);
+	}
+
+	CZstdCompressor(const CZstdCompressor&) = delete;
+	CZstdCompressor& operator=(const CZstdCompressor&) = delete;
+
+	~CZstdCompressor()
+	{
+		ZSTD_freeCCtx(cctx);
+	}
+
+	// Compress data into a series of frames of at most frame_size raw bytes (0 - single frame)
+	// Sizes of frames (packed, raw) are appended to frames
+	bool compress(const uint8_t* src, size_t src_size, memory_block_t& dest, vector<pair<uint32_t, uint32_t>>& frames, size_t frame_size = 0)
+	{
+		if (frame_size == 0)
+			frame_size = std::max<size_t>(src_size, 1);
+
+		size_t no_frames = std::max<size_t>(1, (src_size + frame_size - 1) / frame_size);
+
+		dest.resize(no_frames * ZSTD_compressBound(std::min(frame_size, src_size)));
+		size_t dest_pos = 0;
+		size_t pos = 0;
+
+		do
+		{
+			size_t raw_size = std::min(frame_size, src_size - pos);
+			size_t packed_size = ZSTD_compress2(cctx, dest.data() + dest_pos, dest.size() - dest_pos, src + pos, raw_size);
+
+			if (ZSTD_isError(packed_size))
+			{
+				error = ZSTD_getErrorName(packed_size);
+				dest.clear();
+				return false;
+			}
+
+			frames.emplace_back((uint32_t) packed_size, (uint32_t) raw_size);
+			dest_pos += packed_size;
+			pos += raw_size;
+		} while (pos < src_size);
+
+		dest.resize(dest_pos);
+
+		return true;
+	}
+
+	// Message of the last compression error
+	string get_error() const
+	{
+		return error;
+	}
+
+	// Seek table (skippable frame) of the zstd seekable format
+	static void build_seek_table(const vector<pair<uint32_t, uint32_t>>& frames, vector<uint8_t>& seek_table)
+	{
+		const uint32_t skippable_magic = 0x184D2A5E;
+		const uint32_t seekable_magic = 0x8F92EAB1;
+
+		auto append_u32 = [&seek_table](uint32_t x) {
+			for (int i = 0; i < 4; ++i)
+				seek_table.emplace_back((uint8_t)(x >> (8 * i)));
+			};
+
+		seek_table.clear();
+
+		append_u32(skippable_magic);
+		append_u32((uint32_t) (8 * frames.size() + 9));
+
+		for (const auto& frame : frames)
+		{
+			append_u32(frame.first);
+			append_u32(frame.second);
+		}
+
+		append_u32((uint32_t) frames.size());
+		seek_table.emplace_back(0);						// descriptor: no checksums in seek table
+		append_u32(seekable_magic);
+	}
+};
+#endif